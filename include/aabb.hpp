@@ -0,0 +1,47 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include "vec.hpp"
+#include "ray.hpp"
+
+// Axis-aligned bounding box, empty until something is added
+struct AABB {
+    Vec min, max;
+
+    AABB() : min(1e300, 1e300, 1e300), max(-1e300, -1e300, -1e300) {}
+    AABB(Vec min_, Vec max_) : min(min_), max(max_) {}
+
+    void expand(const Vec& p) {
+        min = Vec(std::min(min.x, p.x), std::min(min.y, p.y), std::min(min.z, p.z));
+        max = Vec(std::max(max.x, p.x), std::max(max.y, p.y), std::max(max.z, p.z));
+    }
+
+    // Componentwise so that merging an empty box changes nothing
+    void expand(const AABB& b) {
+        min = Vec(std::min(min.x, b.min.x), std::min(min.y, b.min.y), std::min(min.z, b.min.z));
+        max = Vec(std::max(max.x, b.max.x), std::max(max.y, b.max.y), std::max(max.z, b.max.z));
+    }
+
+    bool empty() const { return min.x > max.x; }
+    bool unbounded() const { return std::isinf(surfaceArea()); }
+    Vec centroid() const { return (min + max) * 0.5; }
+    Vec extent() const { return max - min; }
+
+    double surfaceArea() const {
+        if (empty()) return 0;
+        Vec d = extent();
+        return 2 * (d.x * d.y + d.y * d.z + d.z * d.x);
+    }
+
+    // Returns the entry distance along the ray, or tMax if the box is missed within (0, tMax)
+    double intersect(const Vec& o, const Vec& invDir, double tMax) const {
+        double t0 = 0, t1 = tMax;
+        const double tx0 = (min.x - o.x) * invDir.x, tx1 = (max.x - o.x) * invDir.x;
+        t0 = std::max(t0, std::min(tx0, tx1)), t1 = std::min(t1, std::max(tx0, tx1));
+        const double ty0 = (min.y - o.y) * invDir.y, ty1 = (max.y - o.y) * invDir.y;
+        t0 = std::max(t0, std::min(ty0, ty1)), t1 = std::min(t1, std::max(ty0, ty1));
+        const double tz0 = (min.z - o.z) * invDir.z, tz1 = (max.z - o.z) * invDir.z;
+        t0 = std::max(t0, std::min(tz0, tz1)), t1 = std::min(t1, std::max(tz0, tz1));
+        return t0 <= t1 ? t0 : tMax;
+    }
+};
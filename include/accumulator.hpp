@@ -0,0 +1,45 @@
+#pragma once
+#include <string>
+#include <iostream>
+#include <vector>
+#include <cstdint>
+
+/*
+ * HDR radiance accumulated over the frames of one view
+ *
+ * Keeps the sum of the traced radiance and the sample count of every pixel.
+ * Sums are float32 with Kahan compensation, so a frame still counts in full
+ * once a long render has made them thousands of times larger than it. Unlike
+ * the denoiser's color buffer it is never clamped, blended with reprojected
+ * history or denoised, and it can be saved raw to continue or merge renders.
+ */
+class Accumulator {
+public:
+	int width, height;
+
+	Accumulator(int w, int h);
+
+	void clear();
+
+	// Adds a frame holding the mean of samples[i] samples in each pixel, radiance times scale.
+	// Pixels without samples are left alone.
+	void add(const float* frame, const float* samples, float scale);
+
+	// Mean radiance of each pixel into rgb, black where nothing was traced
+	void resolve(float* rgb) const;
+
+	uint32_t samples(int pixel) const { return count[pixel]; }
+
+	// Adds the samples of another accumulator of the same resolution
+	void merge(const Accumulator& other);
+
+	// Raw sums, compensation and counts. Reading fails unless they are of this resolution.
+	bool save(const std::string& path) const;
+	bool load(const std::string& path);
+	bool write(std::ostream& out) const;
+	bool read(std::istream& in, const std::string& name);
+
+private:
+	std::vector<float> sum, compensation;	// RGB, rows as in the denoiser's buffers
+	std::vector<uint32_t> count;
+};
@@ -0,0 +1,15 @@
+#pragma once
+#include <cassert>
+
+// Heap allocations made through operator new so far. Only counted in debug builds, always 0 otherwise.
+long long allocationCount();
+
+// Asserts in debug builds that nothing was allocated on the heap, on any thread, while it was alive
+class NoAllocationScope {
+public:
+    NoAllocationScope() : start(allocationCount()) {}
+    ~NoAllocationScope() { assert(allocationCount() == start && "heap allocation inside a NoAllocationScope"); }
+
+private:
+    long long start;
+};
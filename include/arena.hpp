@@ -0,0 +1,49 @@
+#pragma once
+#include <vector>
+#include <cstddef>
+#include <new>
+#include <utility>
+#include <type_traits>
+
+/*
+ * Bump allocator handing out memory from large blocks
+ *
+ * Objects made in an arena are laid out one after another in the order they
+ * were made and are destroyed together, in reverse, by clear() or the
+ * destructor. Nothing is freed on its own, so pointers stay valid until then.
+ * clear() keeps the first block to build into again.
+ */
+class Arena {
+public:
+    explicit Arena(size_t blockSize = 64 * 1024);
+    ~Arena();
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    void* allocate(size_t size, size_t align);
+
+    template <typename T, typename... Args>
+    T* make(Args&&... args) {
+        T* object = new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+        if (!std::is_trivially_destructible<T>::value) {
+            destructors.push_back({ object, [](void* p) { static_cast<T*>(p)->~T(); } });
+        }
+        return object;
+    }
+
+    void clear();
+
+private:
+    struct Block {
+        char* data;
+        size_t size, used;
+    };
+    struct Destructor {
+        void* object;
+        void (*destroy)(void*);
+    };
+
+    size_t blockSize;
+    std::vector<Block> blocks;
+    std::vector<Destructor> destructors;
+};
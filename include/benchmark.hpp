@@ -0,0 +1,25 @@
+#pragma once
+
+/*
+ * Headless benchmarks, run with: --bench <name> [args]
+ *
+ *   refit [instances] [frames]     Moves every instance each frame and times the top-level refit
+ *   build [triangles] [threads]    Times the mesh BVH build against triangle and thread count
+ *   wide [model.stl] [rays]        Compares the binary and quantized wide BVH of a mesh
+ *   leak [rays]                    Counts rays escaping closed meshes through edges and corners
+ *   walls [rays]                   Compares box walls made of huge spheres, planes and quads
+ *   dispatch [rays]                Times virtual shape and BRDF calls, and one hierarchy against one per shape type
+ *   kernels [scene] [spp]          Renders a frame with each specialized integrator kernel
+ *   furnace [samples]              Estimates the albedo of white materials, which must not exceed one
+ *   materials [calls]              Times eval and sampling of each material
+ *   environment [map] [samples]    Checks and times importance sampling of an environment map
+ *   fireflies [scene] [ms] [spp]   Equal-time error of radiance clamping and path regularization against an unclamped reference
+ *   roulette [scene] [ms] [spp]    Equal-time error of path depth limits and Russian roulette against full-depth paths
+ *   accumulation [frames]          Precision of long float32 radiance sums with and without Kahan compensation
+ *   lights [scene] [spp]           Mean radiance with and without light sampling, in a scene lit by the sky and a lamp
+ *   scaling [scene] [spp] [pin] [tile]
+ *                                  Frame time from one worker to every logical processor, pinned unless pin is off,
+ *                                  tracing straight into the shared frame and through per-worker tile buffers
+ */
+
+int runBenchmark(int argc, char* argv[]);
@@ -1,16 +1,40 @@
 #pragma once
 #include "vec.hpp"
 #include "util.hpp"
+#include "sampler.hpp"
+#include "microfacet.hpp"
+#include <cstdint>
 
+// Concrete type of a BRDF, for shading decisions that depend on it such as isDelta()
+enum class BRDFType : uint8_t { Diffuse, Specular, Conductor, Plastic, Dielectric };
+
+// Delta BRDFs scatter into single directions, so eval is of no use for light sampling
+inline bool isDelta(BRDFType type) {
+    return type == BRDFType::Specular || type == BRDFType::Dielectric;
+}
+
+/*
+ * n is the shape's normal and may face away from o; every BRDF but the
+ * dielectric is two-sided and flips it as needed.
+ */
 struct BRDF {
+    const BRDFType type;
+
+    BRDF(BRDFType type) : type(type) {}
+
     virtual Vec eval(const Vec& n, const Vec& o, const Vec& i) const = 0;
-    virtual void sample(const Vec& n, const Vec& o, Vec& i, double& pdf) const = 0;
-    virtual bool isSpecular() const = 0;
+    virtual void sample(const Vec& n, const Vec& o, Vec& i, double& pdf, Sampler& sampler) const = 0;
+
+    // Samples i and returns eval * cos / pdf, which stays finite for delta BRDFs
+    virtual Vec sampleWeight(const Vec& n, const Vec& o, Vec& i, Sampler& sampler) const = 0;
+
+    // Reflectance used as the denoiser's albedo guide
+    virtual Vec albedo() const = 0;
 };
 
 // Ideal diffuse BRDF
-struct DiffuseBRDF : public BRDF {
-    DiffuseBRDF(Vec kd_) : kd(kd_) {}
+struct DiffuseBRDF final : public BRDF {
+    DiffuseBRDF(Vec kd_) : BRDF(BRDFType::Diffuse), kd(kd_) {}
 
     Vec eval(const Vec& n, const Vec& o, const Vec& i) const {
         return kd * (1.0 / PI);
@@ -19,10 +43,12 @@ struct DiffuseBRDF : public BRDF {
     /**
      * Sample using uniformRandomPSA
      */
-    void sample(const Vec& n, const Vec& o, Vec& i, double& pdf) const {
-        double z = sqrt(rng());
+    void sample(const Vec& n, const Vec& o, Vec& i, double& pdf, Sampler& sampler) const {
+        double u1, u2;
+        sampler.get2D(u1, u2);
+        double z = sqrt(u1);
         double r = sqrt(1.0 - z * z);
-        double phi = 2.0 * PI * rng();
+        double phi = 2.0 * PI * u2;
         double x = r * cos(phi);
         double y = r * sin(phi);
         Vec u, v, w;
@@ -31,14 +57,20 @@ struct DiffuseBRDF : public BRDF {
         pdf = clamp(i.dot(n)) / PI;
     }
 
-    bool isSpecular() const { return false; }
+    Vec sampleWeight(const Vec& n, const Vec& o, Vec& i, Sampler& sampler) const {
+        double pdf;
+        sample(n.dot(o) < 0 ? n * -1.0 : n, o, i, pdf, sampler);
+        return kd;
+    }
+
+    Vec albedo() const { return kd; }
 
     Vec kd;
 };
 
 // Ideal specular BRDF
-struct SpecularBRDF : public BRDF {
-    SpecularBRDF(Vec ks_) : ks(ks_) {}
+struct SpecularBRDF final : public BRDF {
+    SpecularBRDF(Vec ks_) : BRDF(BRDFType::Specular), ks(ks_) {}
 
     static Vec mirroredDirection(const Vec& n, const Vec& o) {
         return n * n.dot(o) * 2.0 - o;
@@ -51,12 +83,199 @@ struct SpecularBRDF : public BRDF {
         return Vec();
     }
 
-    void sample(const Vec& n, const Vec& o, Vec& i, double& pdf) const {
+    void sample(const Vec& n, const Vec& o, Vec& i, double& pdf, Sampler& sampler) const {
         i = mirroredDirection(n, o);
         pdf = 1.0;
     }
 
-    bool isSpecular() const { return true; }
+    Vec sampleWeight(const Vec& n, const Vec& o, Vec& i, Sampler& sampler) const {
+        i = mirroredDirection(n, o);
+        return ks;
+    }
+
+    Vec albedo() const { return ks; }
 
     Vec ks;
-};
\ No newline at end of file
+};
+
+// Rough metal, GGX with Schlick's Fresnel tinted by the reflectance f0 at normal incidence
+struct ConductorBRDF final : public BRDF {
+    ConductorBRDF(Vec f0_, double roughness) : BRDF(BRDFType::Conductor), f0(f0_), ggx(roughness) {}
+
+    Vec eval(const Vec& n, const Vec& o, const Vec& i) const {
+        Frame frame(n.dot(o) < 0 ? n * -1.0 : n);
+        Vec lo = frame.toLocal(o), li = frame.toLocal(i);
+        if (lo.z <= 0 || li.z <= 0) return Vec();
+        Vec h = (lo + li).normalize();
+        return fresnelSchlick(f0, lo.dot(h)) * (ggx.D(h) * ggx.G2(lo, li) / (4 * lo.z * li.z));
+    }
+
+    void sample(const Vec& n, const Vec& o, Vec& i, double& pdf, Sampler& sampler) const {
+        Vec lo, li, h;
+        sampleLocal(n, o, i, lo, li, h, sampler);
+        pdf = li.z > 0 ? ggx.pdfReflected(lo, h) : 0;
+    }
+
+    Vec sampleWeight(const Vec& n, const Vec& o, Vec& i, Sampler& sampler) const {
+        Vec lo, li, h;
+        sampleLocal(n, o, i, lo, li, h, sampler);
+        if (li.z <= 0) return Vec();
+        return fresnelSchlick(f0, lo.dot(h)) * (ggx.G2(lo, li) / ggx.G1(lo));
+    }
+
+    Vec albedo() const { return f0; }
+
+    Vec f0;
+    GGX ggx;
+
+private:
+    // Reflects o about a visible normal; li.z <= 0 when the sample fails
+    void sampleLocal(const Vec& n, const Vec& o, Vec& i, Vec& lo, Vec& li, Vec& h, Sampler& sampler) const {
+        double u1, u2;
+        sampler.get2D(u1, u2);
+        Frame frame(n.dot(o) < 0 ? n * -1.0 : n);
+        lo = frame.toLocal(o);
+        if (lo.z <= 0) {
+            li = Vec();
+            i = frame.w;
+            return;
+        }
+        h = ggx.sampleVisible(lo, u1, u2);
+        li = reflect(lo, h);
+        i = frame.toWorld(li);
+    }
+};
+
+// Diffuse base under a smooth-index GGX coat, the coat taking its Fresnel share of the light
+struct PlasticBRDF final : public BRDF {
+    PlasticBRDF(Vec kd_, double roughness, double ior_ = 1.5) : BRDF(BRDFType::Plastic), kd(kd_), ggx(roughness), ior(ior_) {}
+
+    Vec eval(const Vec& n, const Vec& o, const Vec& i) const {
+        Frame frame(n.dot(o) < 0 ? n * -1.0 : n);
+        return evalLocal(frame.toLocal(o), frame.toLocal(i));
+    }
+
+    void sample(const Vec& n, const Vec& o, Vec& i, double& pdf, Sampler& sampler) const {
+        Vec lo, li;
+        sampleLocal(n, o, i, lo, li, sampler);
+        pdf = li.z > 0 ? pdfLocal(lo, li) : 0;
+    }
+
+    Vec sampleWeight(const Vec& n, const Vec& o, Vec& i, Sampler& sampler) const {
+        Vec lo, li;
+        sampleLocal(n, o, i, lo, li, sampler);
+        if (li.z <= 0) return Vec();
+        return evalLocal(lo, li) * (li.z / pdfLocal(lo, li));
+    }
+
+    Vec albedo() const { return kd; }
+
+    Vec kd;
+    GGX ggx;
+    double ior;
+
+private:
+    Vec evalLocal(const Vec& lo, const Vec& li) const {
+        if (lo.z <= 0 || li.z <= 0) return Vec();
+        Vec h = (lo + li).normalize();
+        double coat = fresnelDielectric(lo.dot(h), ior) * ggx.D(h) * ggx.G2(lo, li) / (4 * lo.z * li.z);
+        return kd * ((1 - fresnelDielectric(lo.z, ior)) / PI) + Vec(coat, coat, coat);
+    }
+
+    // Chance of sampling the coat rather than the base, by their share of the reflection towards o
+    double coatProbability(double cosO) const {
+        double coat = fresnelDielectric(cosO, ior);
+        double base = (1 - coat) * (kd.x + kd.y + kd.z) / 3;
+        return coat + base > 0 ? coat / (coat + base) : 1;
+    }
+
+    double pdfLocal(const Vec& lo, const Vec& li) const {
+        double p = coatProbability(lo.z);
+        return p * ggx.pdfReflected(lo, (lo + li).normalize()) + (1 - p) * li.z / PI;
+    }
+
+    void sampleLocal(const Vec& n, const Vec& o, Vec& i, Vec& lo, Vec& li, Sampler& sampler) const {
+        double u = sampler.get1D(), u1, u2;
+        sampler.get2D(u1, u2);
+        Frame frame(n.dot(o) < 0 ? n * -1.0 : n);
+        lo = frame.toLocal(o);
+        if (lo.z <= 0) {
+            li = Vec();
+            i = frame.w;
+            return;
+        }
+        if (u < coatProbability(lo.z)) {
+            li = reflect(lo, ggx.sampleVisible(lo, u1, u2));
+        }
+        else {
+            double r = sqrt(u1), phi = 2 * PI * u2;
+            li = Vec(r * cos(phi), r * sin(phi), sqrt(1 - u1));
+        }
+        i = frame.toWorld(li);
+    }
+};
+
+/*
+ * Smooth glass. Reflects or refracts by the Fresnel reflectance, so the weight
+ * of a sample is white for reflection and kt for transmission. n must point out
+ * of the glass. Radiance isn't rescaled by the squared index ratio on
+ * crossing, which cancels for closed objects.
+ */
+struct DielectricBRDF final : public BRDF {
+    DielectricBRDF(Vec kt_, double ior_ = 1.5) : BRDF(BRDFType::Dielectric), kt(kt_), ior(ior_) {}
+
+    Vec eval(const Vec& n, const Vec& o, const Vec& i) const {
+        return Vec();
+    }
+
+    // pdf is the probability of the direction taken, as for the ideal specular BRDF
+    void sample(const Vec& n, const Vec& o, Vec& i, double& pdf, Sampler& sampler) const {
+        double reflectance;
+        pdf = scatter(n, o, i, reflectance, sampler) ? 1 - reflectance : reflectance;
+    }
+
+    Vec sampleWeight(const Vec& n, const Vec& o, Vec& i, Sampler& sampler) const {
+        double reflectance;
+        return scatter(n, o, i, reflectance, sampler) ? kt : Vec(1, 1, 1);
+    }
+
+    Vec albedo() const { return kt; }
+
+    Vec kt;
+    double ior;
+
+private:
+    // Returns true if i refracts through the surface
+    bool scatter(const Vec& n, const Vec& o, Vec& i, double& reflectance, Sampler& sampler) const {
+        double cosI = n.dot(o), eta = ior;
+        Vec m = n;
+        if (cosI < 0) {
+            cosI = -cosI, eta = 1 / ior, m = n * -1.0;
+        }
+        reflectance = fresnelDielectric(cosI, eta);
+        if (sampler.get1D() < reflectance) {
+            i = reflect(o, m);
+            return false;
+        }
+        double cosT = sqrt(std::max(0.0, 1 - (1 - cosI * cosI) / (eta * eta)));
+        i = o * (-1 / eta) + m * (cosI / eta - cosT);
+        return true;
+    }
+};
+
+/*
+ * Glossy lobes smoother than deltaRoughness are too narrow for light sampling:
+ * a light sample lands in one rarely and then carries the lobe's huge peak, so
+ * such lobes are sampled like delta BRDFs and see the lights they reflect by
+ * hitting them.
+ */
+constexpr double deltaRoughness = 0.1;
+
+inline bool isDelta(const BRDF& brdf) {
+    const double alpha = deltaRoughness * deltaRoughness;
+    switch (brdf.type) {
+    case BRDFType::Conductor: return static_cast<const ConductorBRDF&>(brdf).ggx.alpha < alpha;
+    case BRDFType::Plastic: return static_cast<const PlasticBRDF&>(brdf).ggx.alpha < alpha;
+    default: return isDelta(brdf.type);
+    }
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+/*
+ * Frame-time budget controller
+ *
+ * Measures the path tracing throughput of past frames in pixel samples per
+ * millisecond and picks the samples per pixel of the next frame so it fits
+ * the target frame time.
+ */
+
+class FrameBudget {
+public:
+	double targetTime;		// Target trace time of a frame in ms
+	double throughput;		// Smoothed pixel samples traced per ms, 0 until the first measurement
+	double lastTime;		// Trace time of the last recorded frame in ms
+
+	FrameBudget(double targetTime, int maxSamples = 256);
+
+	// Samples per pixel for a frame of the given pixel count, a power of two.
+	int samplesFor(int pixels) const;
+
+	// Records that pixelSamples samples were traced in time ms.
+	void record(double pixelSamples, double time);
+
+private:
+	int maxSamples;
+};
@@ -0,0 +1,79 @@
+#pragma once
+#include <vector>
+#include <cassert>
+#include "aabb.hpp"
+
+/*
+ * Bounding volume hierarchy over primitive bounds
+ *
+ * Built top-down with binned SAH splits. Large builds split the work over
+ * threads: big nodes bin their primitives in parallel and subtrees are
+ * handed to their own thread until the thread budget is used up. Subtrees
+ * that could grow past maxDepth are split at the median instead, so
+ * traversal fits a fixed stack.
+ *
+ * Moving primitives are handled by refitting the boxes bottom-up, which
+ * keeps the topology; cost() tracks how much a refit has degraded the tree
+ * so callers can rebuild.
+ */
+
+struct BVHNode {
+    AABB box;
+    int start, count;   // Leaf: indices[start, start + count). Inner: count == 0, children at start and start + 1
+};
+
+class BVH {
+public:
+    std::vector<BVHNode> nodes;
+    std::vector<int> indices;   // Primitive ids ordered by leaf
+
+    static constexpr int maxDepth = 64;     // Most inner nodes on a path from the root
+
+    // Uses up to numThreads threads, 0 for all hardware threads
+    void build(const std::vector<AABB>& bounds, int numThreads = 0);
+
+    // Recomputes every box from new primitive bounds, children always follow their parent
+    void refit(const std::vector<AABB>& bounds);
+
+    // Expected cost of tracing a ray by the surface area heuristic
+    double cost() const;
+
+    /*
+     * Finds the closest hit within (0, tMax). intersect(prim) returns the hit
+     * distance along ray.d, or 0 on a miss. Returns 0 if nothing was hit.
+     * Adds the number of inner nodes visited to steps when given.
+     */
+    template <typename Intersect>
+    double traverse(const Ray& ray, double tMax, Intersect&& intersect, int* steps = nullptr) const {
+        if (nodes.empty()) return 0;
+        const Vec invDir(1 / ray.d.x, 1 / ray.d.y, 1 / ray.d.z);
+        double closest = tMax;
+        int stack[maxDepth + 1], size = 0;  // Each inner node pops one entry and pushes at most two
+        if (nodes[0].box.intersect(ray.o, invDir, closest) >= closest) return 0;
+        stack[size++] = 0;
+        while (size) {
+            const BVHNode& node = nodes[stack[--size]];
+            if (node.count) {
+                for (int i = node.start; i < node.start + node.count; ++i) {
+                    double d = intersect(indices[i]);
+                    if (d > 0 && d < closest) closest = d;
+                }
+                continue;
+            }
+            if (steps) ++*steps;
+
+            // Visit the nearer child first
+            double t0 = nodes[node.start].box.intersect(ray.o, invDir, closest);
+            double t1 = nodes[node.start + 1].box.intersect(ray.o, invDir, closest);
+            int first = node.start, second = node.start + 1;
+            if (t1 < t0) {
+                std::swap(t0, t1);
+                std::swap(first, second);
+            }
+            if (t1 < closest) stack[size++] = second;
+            if (t0 < closest) stack[size++] = first;
+            assert(size <= maxDepth + 1);
+        }
+        return closest < tMax ? closest : 0;
+    }
+};
@@ -1,18 +1,23 @@
 #pragma once
 #include <OpenImageDenoise/oidn.hpp>
 #include <windows.h>
+#include <vector>
+#include <thread>
 #include "sphere.hpp"
 #include "camera.hpp"
 #include "scene.hpp"
+#include "workerpool.hpp"
 
 class OIDNDenoiser {
 public:
 	int width, height;
 	float *colorData, *albedoData, *normalData;
+	std::vector<float> depthData;	// Distance to the first hit through each pixel center, 0 on a miss
 
 	OIDNDenoiser(int w, int h);
 
-	void computeAuxiliary(const Shape* shapes[], const Camera& cam);
+	// Traces the first hits of all pixel centers, split in row bands over the workers.
+	void computeAuxiliary(const Scene& scene, const Camera& cam, WorkerPool& workers);
 	void execute();
 
 	void writeBits(void* bits);
@@ -21,4 +26,7 @@ private:
 	oidn::BufferRef colorBuffer;
 	oidn::BufferRef albedoBuffer;
 	oidn::BufferRef normalBuffer;
+	oidn::FilterRef filter;		// Set up once, the buffers never move
+
+	void computeAuxiliaryRows(const Scene& scene, const Camera& cam, int startY, int endY);
 };
\ No newline at end of file
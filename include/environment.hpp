@@ -0,0 +1,43 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <istream>
+#include "vec.hpp"
+#include "sampler.hpp"
+
+/*
+ * HDR environment map in latitude-longitude layout, +y up
+ *
+ * Loaded from PFM or Radiance HDR files a row at a time straight into the
+ * texel array. Directions are sampled in proportion to radiance times the
+ * solid angle of each texel: an alias table over the rows picks a row and the
+ * row's own alias table picks a texel, each in constant time.
+ */
+class Environment {
+public:
+    int width = 0, height = 0;
+
+    // Returns false and leaves the map empty if the file can't be read.
+    bool load(const std::string& path, double scale = 1);
+    void clear();
+    bool empty() const { return texels.empty(); }
+
+    // Radiance arriving along -d, d being a unit direction away from the scene
+    Vec radiance(const Vec& d) const;
+
+    // Draws a unit direction d towards the environment and returns the radiance from it
+    Vec sample(Vec& d, double& pdf, Sampler& sampler) const;
+
+    // Solid angle density of sample() drawing d
+    double pdf(const Vec& d) const;
+
+private:
+    std::vector<float> texels;          // RGB, top row first
+    std::vector<float> probability;     // Of sampling each texel
+    std::vector<float> threshold;       // Alias tables of the rows, texel by texel, then the one over the rows
+    std::vector<int> alias;
+
+    bool readHDR(std::istream& in);
+    void buildDistribution();
+    int texelOf(const Vec& d) const;
+};
@@ -9,6 +9,8 @@ extern boolean inFocus;
 extern std::atomic<bool> input_flags[6];   // Flags indicating a key was held down during a frame.
 extern std::atomic<int> dx, dy;
 extern std::atomic<bool> newInput;
+extern std::atomic<long long> inputTime;    // Time of the first input since the last camera update, in steady_clock ticks
+extern std::atomic<bool> saveRequested;     // P was pressed, the accumulated HDR radiance is to be saved
 
 void handleInput(HWND hwnd);
 
@@ -16,4 +18,6 @@ void handleMouseInput(HWND hwnd);
 
 void centerMouse(HWND hwnd);
 
-void updateCamera(Camera& camera);
\ No newline at end of file
+void updateCamera(Camera& camera);
+
+void raiseInput();
\ No newline at end of file
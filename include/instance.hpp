@@ -0,0 +1,23 @@
+#pragma once
+#include "shape.hpp"
+#include "sphere.hpp"
+#include "stlmodel.hpp"
+#include "transform.hpp"
+
+// A shared STLModel placed in the scene through an affine transform
+class Instance final : public Shape {
+public:
+    const STLModel& model;
+    Transform toWorld, toObject;
+    Sphere boundingSphere;
+
+    Instance(const STLModel& model, const Transform& toWorld, Vec e, const BRDF& brdf);
+
+    void setTransform(const Transform& toWorld);
+
+    double intersect(const Ray& ray, Vec* point, Vec* normal) const override;
+
+    void sample(Vec& point, Vec& normal, double& pdf, Sampler& sampler) const override;
+
+    AABB bounds() const override;
+};
@@ -0,0 +1,81 @@
+#pragma once
+#include "vec.hpp"
+#include "util.hpp"
+#include <algorithm>
+
+/*
+ * Microfacet helpers for the glossy BRDFs
+ *
+ * Directions are taken into a frame with the normal along z. GGX samples the
+ * normals visible from o [Heitz 2018, Sampling the GGX Distribution of Visible
+ * Normals], which makes the weight of a reflected sample F * G2 / G1: it stays
+ * below one at grazing angles where sampling D alone produces fireflies.
+ */
+
+struct Frame {
+    Vec u, v, w;
+
+    explicit Frame(const Vec& n) { createLocalCoord(n, u, v, w); }
+
+    Vec toLocal(const Vec& d) const { return Vec(d.dot(u), d.dot(v), d.dot(w)); }
+    Vec toWorld(const Vec& d) const { return u * d.x + v * d.y + w * d.z; }
+};
+
+struct GGX {
+    double alpha;
+
+    // Perceptually linear roughness in [0, 1]
+    explicit GGX(double roughness) : alpha(std::max(roughness * roughness, 1e-4)) {}
+
+    double D(const Vec& h) const {
+        const double a2 = alpha * alpha, d = h.z * h.z * (a2 - 1) + 1;
+        return a2 / (PI * d * d);
+    }
+
+    double lambda(const Vec& d) const {
+        const double cos2 = d.z * d.z;
+        if (cos2 >= 1) return 0;
+        return (sqrt(1 + alpha * alpha * (1 - cos2) / cos2) - 1) * 0.5;
+    }
+
+    double G1(const Vec& d) const { return 1 / (1 + lambda(d)); }
+    double G2(const Vec& o, const Vec& i) const { return 1 / (1 + lambda(o) + lambda(i)); }
+
+    // Microfacet normal visible from o, which must be above the surface
+    Vec sampleVisible(const Vec& o, double u1, double u2) const {
+        const Vec vh = Vec(alpha * o.x, alpha * o.y, o.z).normalize();
+        const double lengthSq = vh.x * vh.x + vh.y * vh.y;
+        const Vec t1 = lengthSq > 0 ? Vec(-vh.y, vh.x, 0) * (1 / sqrt(lengthSq)) : Vec(1, 0, 0);
+        const Vec t2 = vh.cross(t1);
+        const double r = sqrt(u1), phi = 2 * PI * u2;
+        const double p1 = r * cos(phi), s = 0.5 * (1 + vh.z);
+        const double p2 = (1 - s) * sqrt(1 - p1 * p1) + s * r * sin(phi);
+        const Vec nh = t1 * p1 + t2 * p2 + vh * sqrt(std::max(0.0, 1 - p1 * p1 - p2 * p2));
+        return Vec(alpha * nh.x, alpha * nh.y, std::max(0.0, nh.z)).normalize();
+    }
+
+    // Density of the direction reflected about a visible normal h
+    double pdfReflected(const Vec& o, const Vec& h) const {
+        return G1(o) * D(h) / (4 * o.z);
+    }
+};
+
+inline Vec reflect(const Vec& o, const Vec& h) {
+    return h * (2 * h.dot(o)) - o;
+}
+
+// Unpolarized reflectance of a smooth boundary, eta is the ratio of the far side's index to the near side's
+inline double fresnelDielectric(double cosI, double eta) {
+    const double sin2T = (1 - cosI * cosI) / (eta * eta);
+    if (sin2T >= 1) return 1;
+    const double cosT = sqrt(1 - sin2T);
+    const double rs = (cosI - eta * cosT) / (cosI + eta * cosT);
+    const double rp = (eta * cosI - cosT) / (eta * cosI + cosT);
+    return 0.5 * (rs * rs + rp * rp);
+}
+
+// Schlick's approximation tinted by the reflectance at normal incidence, for metals
+inline Vec fresnelSchlick(const Vec& f0, double cosI) {
+    const double m = 1 - std::max(0.0, cosI), m2 = m * m;
+    return f0 + (Vec(1, 1, 1) - f0) * (m2 * m2 * m);
+}
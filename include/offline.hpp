@@ -0,0 +1,39 @@
+#pragma once
+
+/*
+ * Headless offline rendering, split over machines by seed
+ *
+ *   --render <scene> <checkpoint> [--spp n] [--seed s] [--every seconds] [--size w h] [--trace path] [render settings] [thread placement]
+ *       Traces the scene's camera view until every pixel has n samples (1024), saving the
+ *       checkpoint every so often (60 s) and at the end. Workers are placed by --threads,
+ *       --smt and --pin (see topology.hpp). An existing checkpoint is resumed with its own
+ *       seed, settings and sample count; only --spp, --every, --trace and the placement
+ *       apply then. --trace writes a Chrome trace of the render and prints the ray
+ *       counts per sample, in builds with ENABLE_PROFILING (see profiler.hpp).
+ *
+ *   --merge <image.pfm> <checkpoint>...
+ *       Adds up checkpoints of the same view rendered with different seeds and the same
+ *       render settings, and writes the mean radiance of their samples.
+ *
+ *   --compare <image.pfm> <reference.pfm> [tolerance]
+ *       Fails if the RMSE of image against reference exceeds tolerance (0.01) times the
+ *       reference's mean, for checking renders against golden images. tests/references.py
+ *       checks every bundled scene and model this way against tests/references.
+ *
+ * A checkpoint holds the accumulated HDR sums and per-pixel sample counts (see
+ * accumulator.hpp) and the sampler state: its type, seed and the next sample
+ * index. The sampler is counter based, so the index is all a resumed render
+ * needs to carry on with fresh samples, and checkpoints with different seeds
+ * hold independent samples whose counts simply add. n nodes with seeds 0 to
+ * n-1 and --spp N/n each give N samples per pixel in 1/n of the time.
+ *
+ * Offline renders are deterministic: every sample is drawn from its pixel,
+ * sample index and seed, and each pixel is traced and summed by one thread in
+ * sample order, so a scene, size, seed, sample count and settings give the
+ * same bits on any number of threads. Resuming splits the passes differently
+ * and may change the last bits.
+ */
+
+int renderOffline(int argc, char* argv[]);
+int mergeCheckpoints(int argc, char* argv[]);
+int compareImages(int argc, char* argv[]);
@@ -6,23 +6,104 @@
 #include "sphere.hpp"
 #include "input.hpp"
 #include "window.hpp"
+#include "sampler.hpp"
+#include "upscaler.hpp"
+#include "workerpool.hpp"
 #include <thread>
+#include <vector>
+#include <chrono>
+#include <algorithm>
 
-extern std::atomic<int> workersDone;
+// Features compiled into a render kernel, so the per-sample loops carry no checks for the others
+enum KernelFeature : unsigned {
+	KernelPreview = 1,		// Direct light at the first hit only
+	KernelSpecular = 2,		// The scene has mirrors, glass or glossy materials; without it every material is taken to be diffuse
+	KernelNextEvent = 4,	// Lights are sampled at diffuse hits, otherwise only BRDF samples find them
+	KernelEnvironment = 8,	// Rays leaving the scene see the environment map, which is sampled as a light
+};
+
+// Scale from radiance to the values traced into the frame, which are displayed as they are
+constexpr double exposure = 0.25;
+
+// Bounces no path goes past whatever the settings, which bounds the recursion's stack
+constexpr int maxPathBounces = 64;
+
+// Controls trading bias for variance and path length for speed, shared by every kernel
+struct RenderSettings {
+	double maxBounceRadiance = 0;	// Most radiance per channel a bounce passes back along its path, 0 for no limit
+	double regularization = 0;		// Least roughness of mirrors and glossy surfaces after a diffuse bounce, 0 for none
+	int maxDepth = 16;				// Most bounces of a path, mirrors and glass included, 0 for direct light only
+	int rouletteDepth = 3;			// Bounces a path always takes before Russian roulette may end it
+	double rouletteSurvival = 0.95;	// Highest chance roulette lets a path go on, lower as its throughput drops
+};
+
+/*
+ * Applies a command line option to settings and returns true if it is one of:
+ *   --clamp <radiance>        most radiance a bounce passes back along its path
+ *   --regularize <roughness>  least roughness of mirrors and glossy surfaces after a diffuse bounce
+ *   --depth <bounces>         most bounces of a path
+ *   --roulette <bounces>      bounces a path takes before Russian roulette may end it
+ */
+bool parseRenderSetting(const char* option, const char* value, RenderSettings& settings);
+
+// Traces spp samples into each pixel of [startX, endX) x [startY, endY) of a width x height frame. Pixels are
+// stored, not added, into tile with the top row first and rows stride floats apart, as frames are laid out,
+// so a whole frame can be traced in place with a stride of width * 3.
+typedef void (*TileKernel)(const Scene& scene, const RenderSettings& settings, float* tile, int stride, int width, int height, int spp, uint32_t sampleOffset, int startX, int startY, int endX, int endY, const Camera& camera, Sampler& sampler);
+
+// Edge of the largest tile traced into a worker's own buffer
+constexpr int maxTileSize = 32;
+
+// Copies a traced tile into its place in frame with streaming stores. Workers keep no lines of the shared
+// frame in their caches, so neighbouring tiles never bounce a line between cores, and the stores are
+// fenced, visible to whoever sees the tile finished.
+void commitTile(const float* tile, int stride, float* frame, int width, int height, int startX, int startY, int endX, int endY);
+
+// Features a frame of scene needs. Preview always samples the lights, it would be black otherwise.
+unsigned kernelFeatures(const Scene& scene, bool preview, bool nextEvent);
+TileKernel tileKernel(unsigned features);
 
 class PathTracer {
 public:
-	PathTracer(float* data, int width, int height, Camera& camera, Window& window);
-	void pathTrace(int samps);
+	PathTracer(const Scene& scene, float* data, int width, int height, Camera& camera, Window& window, WorkerPool& workers);
+
+	// Traces at 1/scale of the resolution and upscales into data when scale > 1.
+	// Returns false if new input cancelled the frame; only the finished tiles are then written.
+	bool pathTrace(int spp, bool preview, int scale = 1);
+
+	SamplerType samplerType = SamplerType::Sobol;
+	bool nextEvent = true;				// Sample the lights at diffuse hits
+	RenderSettings settings;
+	std::vector<float> pixelSamples;	// Samples traced into each pixel of data by the last frame
+	const float* guideDepth = nullptr;	// Full resolution guides for upscaling
+	const float* guideNormal = nullptr;
+	int tilesDone, numTiles;
+	double maxTileTime;				// Longest single tile of the last frame in ms, the worst-case wait for cancellation
 
 private:
+	const Scene& scene;
 	Window& window;
 	Camera& camera;
+	WorkerPool& workers;
 	float* data;
 	int width, height, numThreads;
-};
+	uint32_t sampleOffset;	// Samples already taken, so accumulated frames draw fresh sample indices
+
+	int renderWidth, renderHeight;	// Resolution of the current frame
+	float* target;					// data, or lowData when rendering below full resolution
+	float* targetSamples;
+	std::vector<float> lowData, lowSamples;
+
+	int tileSize, tilesX;
+	std::atomic<int> nextTile, finishedTiles;
+	std::atomic<bool> cancelled;
 
-void pathTraceThread(float* data, int width, int height, int samps, int startY, int endY, const Camera& camera);
+	// State only its worker writes, each in its own pages on the worker's NUMA node
+	struct WorkerScratch {
+		double maxTileTime;
+		alignas(64) float tile[maxTileSize * maxTileSize * 3];	// Rows maxTileSize * 3 floats apart
+	};
+	std::vector<NodeBuffer> workerScratch;
 
-Vec reflectedRadiance(const Ray& r, int depth, bool firstFrame);
-Vec receivedRadiance(const Ray& r, int depth, bool firstFrame);
\ No newline at end of file
+	void pathTraceThread(int worker, int spp, TileKernel kernel);
+};
\ No newline at end of file
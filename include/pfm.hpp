@@ -0,0 +1,18 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <istream>
+
+/*
+ * Portable float map images, RGB or greyscale
+ *
+ * Pixels are kept as RGB floats with the top row first, as in every image
+ * buffer of the renderer; the files store rows bottom to top.
+ */
+
+// Greyscale files are read into all three channels
+bool readPFM(std::istream& in, int& width, int& height, std::vector<float>& rgb);
+bool readPFM(const std::string& path, int& width, int& height, std::vector<float>& rgb);
+
+// Little-endian RGB
+bool writePFM(const std::string& path, const float* rgb, int width, int height);
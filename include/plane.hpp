@@ -0,0 +1,19 @@
+#pragma once
+#include "shape.hpp"
+#include "brdf.hpp"
+#include "ray.hpp"
+#include "vec.hpp"
+
+// Infinite plane through a point. It has no finite area to sample, so it can't be a light.
+struct Plane final : public Shape {
+    Vec p;          // point on the plane
+    Vec n;          // unit normal
+
+    Plane(Vec p_, Vec n_, Vec e_, const BRDF& brdf_);
+
+    double intersect(const Ray& r, Vec* point, Vec* normal) const override;
+
+    void sample(Vec& point, Vec& normal, double& pdf, Sampler& sampler) const override;
+
+    AABB bounds() const override;
+};
@@ -0,0 +1,76 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <chrono>
+
+/*
+ * Hot-path counters and scoped stage timers, exported as Chrome trace JSON
+ *
+ * Compiled in only when ENABLE_PROFILING is defined; otherwise PROFILE_SCOPE
+ * and PROFILE_COUNT expand to nothing and the functions below do nothing.
+ * Every thread counts into its own slot, so counting is a plain add with no
+ * sharing between threads. Traversal code counts into locals and adds them
+ * once per query. Events go into buffers reserved by startProfiling, so
+ * recording never allocates; events past a full buffer are dropped.
+ *
+ * Load writeProfile's file in chrome://tracing or ui.perfetto.dev: stages
+ * show as nested spans per thread, and the counters as per-frame tracks.
+ */
+
+enum ProfileCounter {
+	CounterRays,			// Scene intersection queries of any kind
+	CounterShadowRays,		// Visibility tests of light samples, one or two queries each
+	CounterTraversalSteps,	// Inner BVH nodes visited, of the scene and of meshes
+	CounterTriangleTests,	// Ray-triangle tests in mesh leaves
+	NumCounters
+};
+
+#ifdef ENABLE_PROFILING
+constexpr bool profilingEnabled = true;
+
+// This thread's counters, claiming a slot on first use
+uint64_t* claimProfileSlot();
+extern thread_local uint64_t* threadCounters;
+
+inline void profileCount(ProfileCounter counter, uint64_t n) {
+	uint64_t* counters = threadCounters ? threadCounters : claimProfileSlot();
+	counters[counter] += n;
+}
+
+// Records the time from construction to destruction as a span of this thread
+class ProfileScope {
+public:
+	explicit ProfileScope(const char* name) : name(name), start(std::chrono::steady_clock::now()) {}
+	~ProfileScope();
+
+private:
+	const char* name;
+	std::chrono::steady_clock::time_point start;
+};
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name)
+#define PROFILE_COUNT(counter, n) profileCount(counter, n)
+#else
+constexpr bool profilingEnabled = false;
+
+#define PROFILE_SCOPE(name)
+#define PROFILE_COUNT(counter, n)
+#endif
+
+// Reserves event buffers for up to threads threads and frames frames and starts recording.
+// Returns false, saying so, when profiling isn't compiled in.
+bool startProfiling(int threads, int frames, int eventsPerThread = 1 << 16);
+void stopProfiling();
+
+// Names the calling thread in the trace
+void profileThreadName(const char* name);
+
+// Records the counters added since the last call as one frame
+void profileFrame();
+
+// Counters summed over all threads since profiling started
+void profileTotals(uint64_t* totals);
+
+bool writeProfile(const std::string& path);
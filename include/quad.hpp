@@ -0,0 +1,21 @@
+#pragma once
+#include "shape.hpp"
+#include "brdf.hpp"
+#include "ray.hpp"
+#include "vec.hpp"
+
+// Parallelogram spanned by two edges from a corner, sampled uniformly by area so it can be a light
+struct Quad final : public Shape {
+    Vec corner, u, v;   // corner and the two edges from it
+    Vec n;              // unit normal, u x v
+    Vec w;              // (u x v) / |u x v|^2, gives the edge coordinates of a point
+    double area;
+
+    Quad(Vec corner_, Vec u_, Vec v_, Vec e_, const BRDF& brdf_);
+
+    double intersect(const Ray& r, Vec* point, Vec* normal) const override;
+
+    void sample(Vec& point, Vec& normal, double& pdf, Sampler& sampler) const override;
+
+    AABB bounds() const override;
+};
@@ -0,0 +1,31 @@
+#pragma once
+#include <cstdint>
+
+/*
+ * Per-pixel sample generator
+ *
+ * Sobol draws every dimension from an Owen-scrambled (0,2)-sequence. Each
+ * dimension gets its own scramble and index shuffle seeded from the pixel and
+ * dimension, so the pixel jitter, light samples and BRDF samples of a pixel
+ * are each well stratified over its samples. Independent draws plain hashed
+ * uniforms and is kept for comparison.
+ */
+
+enum class SamplerType { Independent, Sobol };
+
+class Sampler {
+public:
+    SamplerType type;
+    uint32_t seed;
+
+    Sampler(SamplerType type = SamplerType::Sobol, uint32_t seed = 0);
+
+    // Must be called before drawing the dimensions of a new pixel sample.
+    void startPixelSample(int x, int y, uint32_t sampleIndex);
+
+    double get1D();
+    void get2D(double& u1, double& u2);
+
+private:
+    uint32_t pixelSeed, index, dimension;
+};
@@ -1,10 +1,92 @@
 #pragma once
+#include <string>
+#include <vector>
+#include <map>
+#include <istream>
 #include "brdf.hpp"
 #include "shape.hpp"
 #include "sphere.hpp"
+#include "plane.hpp"
+#include "quad.hpp"
 #include "triangle.hpp"
 #include "stlmodel.hpp"
+#include "instance.hpp"
+#include "bvh.hpp"
+#include "transform.hpp"
+#include "arena.hpp"
+#include "environment.hpp"
 
-extern const Shape* shapes[];
+/*
+ * Scene loaded from a text description
+ *
+ * One directive per line, '#' starts a comment:
+ *   camera <x> <y> <z>
+ *   environment <path> [<scale>]
+ *   diffuse <name> <r> <g> <b>
+ *   specular <name> <r> <g> <b>
+ *   conductor <name> <r> <g> <b> <roughness>
+ *   plastic <name> <r> <g> <b> <roughness> [<ior>]
+ *   glass <name> <r> <g> <b> [<ior>]
+ *   sphere <material> <radius> <x> <y> <z> [<er> <eg> <eb>]
+ *   plane <material> <x> <y> <z> <nx> <ny> <nz>
+ *   quad <material> <x> <y> <z> <ux> <uy> <uz> <vx> <vy> <vz> [<er> <eg> <eb>]
+ *   mesh <name> <path>
+ *   instance <material> <mesh> <x> <y> <z> <scale> [<rx> <ry> <rz> [<er> <eg> <eb>]]
+ *   model <material> <path> <x> <y> <z> <scale> [<er> <eg> <eb>]
+ * Roughness runs from 0, smooth, to 1. A conductor's color is its reflectance
+ * at normal incidence, a plastic's the diffuse base under its clear coat and
+ * glass tints what passes through it; the index of refraction defaults to 1.5.
+ * Glass must face outwards, so use it on spheres and closed meshes.
+ * The environment is a latitude-longitude .pfm or .hdr image lighting the scene
+ * from infinitely far away, its radiance multiplied by scale.
+ * A plane passes through a point with the given normal and can't emit. A quad
+ * spans the edges u and v from the corner at x y z. Rotations are in degrees about x, y then z. model is a shorthand for an instance
+ * of the mesh loaded from path; each file is loaded once however often it is used.
+ * Paths containing spaces are quoted. Materials and meshes may be used before they are declared.
+ */
 
-bool intersect(const Ray& r, double& t, int& id, Vec* point, Vec* normal);
\ No newline at end of file
+class Scene {
+public:
+    std::vector<const Shape*> shapes;   // Every shape in file order, ids returned by intersect index this
+    std::vector<int> lights;            // Ids of the emitting shapes
+    bool hasSpecular = false;           // Some shape has a material other than diffuse
+    Environment environment;            // Radiance of rays leaving the scene, empty for black
+    Vec cameraPos;
+
+    // Top-level hierarchy over the bounded shapes, refitted by update(). Planes are tested against every ray instead.
+    BVH bvh;
+    double rebuildThreshold = 1.5;      // Rebuild once refits have grown the SAH cost by this factor
+    double lastUpdateTime = 0;          // Duration of the last update() in ms
+    int refits = 0, rebuilds = 0;
+
+    Scene();
+    Scene(const Scene&) = delete;
+    Scene& operator=(const Scene&) = delete;
+
+    // Returns false and leaves the scene empty if the file can't be read or parsed.
+    bool load(const std::string& filepath);
+    bool load(std::istream& in, const std::string& name);
+
+    // Moves the instance with the given shape id; takes effect on the next update(). Returns false for other shapes.
+    bool setTransform(int id, const Transform& toWorld);
+
+    // Refits the top-level hierarchy to moved instances, rebuilding it if its quality has degraded too far.
+    void update();
+
+    bool intersect(const Ray& r, double& t, int& id, Vec* point, Vec* normal) const;
+
+private:
+    // Meshes, materials and shapes in load order, so a shape's BRDF sits a few cache lines before it
+    Arena objects;
+    std::map<std::string, const BRDF*> materials;
+
+    std::vector<Instance*> instanceById;    // Null for shapes that are not instances
+    std::vector<int> bounded, unbounded;    // Ids of the shapes inside and outside the hierarchy, primitive i of bvh is shape bounded[i]
+    std::vector<int> primitiveOf;           // Index in bounded by shape id
+    std::vector<AABB> shapeBounds;          // By primitive
+    std::vector<int> dirty;
+    double builtCost = 0;
+
+    void clear();
+    void build();
+};
@@ -1,6 +1,7 @@
 #pragma once
 #include "ray.hpp"
 #include "brdf.hpp"
+#include "aabb.hpp"
 
 struct Shape {
 	const BRDF& brdf;
@@ -12,5 +13,7 @@ struct Shape {
 
 	virtual double intersect(const Ray& ray, Vec* point, Vec* normal) const = 0;
 
-	virtual void sample(Vec& point, Vec& normal, double& pdf) const = 0;
+	virtual void sample(Vec& point, Vec& normal, double& pdf, Sampler& sampler) const = 0;
+
+	virtual AABB bounds() const = 0;
 };
\ No newline at end of file
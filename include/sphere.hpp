@@ -5,7 +5,7 @@
 #include "vec.hpp"
 #include "util.hpp"
 
-struct Sphere : public Shape {
+struct Sphere final : public Shape {
     Vec p;           // position, emitted radiance
     double rad;         // radius
 
@@ -13,5 +13,7 @@ struct Sphere : public Shape {
 
     double intersect(const Ray& r, Vec* point, Vec* normal) const override;
 
-    void sample(Vec& point, Vec& normal, double& pdf) const override;
+    void sample(Vec& point, Vec& normal, double& pdf, Sampler& sampler) const override;
+
+    AABB bounds() const override;
 };
\ No newline at end of file
@@ -4,28 +4,36 @@
 #include <iostream>
 #include <limits>
 #include <cmath>
-#include "sphere.hpp"
 #include "triangle.hpp"
+#include "sampler.hpp"
+#include "widebvh.hpp"
 
-class STLModel : public Shape {
+// Triangle mesh loaded from a binary STL file, centered on the origin. Placed in scenes through Instances.
+class STLModel {
 public:
-    std::vector<Triangle> triangles;
-    Vec pos;
+    std::vector<Triangle> triangles;    // In BVH leaf order
+    std::vector<TriangleVertices> vertices;     // Their corners packed for intersection
     double maxDist, totalSurfaceArea;
-    Sphere boundingSphere;
+    double radius;      // Radius of the bounding sphere around the origin
+    AABB box;
+    WideBVH bvh;        // Over the triangles, built on all cores at load
+    double buildTime;   // Of the BVH in ms
 
-    STLModel(const std::string& filepath, const BRDF& brdf, Vec pos, Vec e = Vec(), bool normalize = true, double scale = 1);
+    // Leaves the model without triangles if the file can't be read
+    STLModel(const std::string& filepath, bool normalize = true);
+
+    // Returns the ray parameter of the nearest hit, 0 if none
+    double intersect(const Ray& ray, Vec* normal) const;
+
+    // Picks a triangle with probability proportional to its area
+    const Triangle& sampleTriangle(double u, double& pdf) const;
 
 private:
     std::vector<double> cdf;
 
-    void loadSTL(const std::string& filepath);
+    bool loadSTL(const std::string& filepath);
 
     void normalizeModel();
 
-    double intersect(const Ray& ray, Vec* point, Vec* normal) const override;
-
-    void sample(Vec& point, Vec& normal, double& pdf) const override;
-
     void computeSurfaceAreas();
-};
\ No newline at end of file
+};
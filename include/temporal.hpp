@@ -0,0 +1,34 @@
+#pragma once
+#include <vector>
+#include "camera.hpp"
+
+/*
+ * Temporal reprojection of accumulated radiance
+ *
+ * Keeps the running mean radiance and sample count of every pixel. When the
+ * camera moves, each new pixel's first hit is projected into the previous
+ * camera to fetch its history; history is rejected where the previous depth
+ * disagrees (disocclusion) or the point was off screen.
+ */
+
+class TemporalReprojector {
+public:
+	int width, height;
+
+	TemporalReprojector(int w, int h);
+
+	// Warps the history into cam's view, using cam's first-hit depth buffer.
+	void reproject(const Camera& cam, const float* depth);
+
+	// Blends a traced frame into the history and writes the result back. samples holds the
+	// samples traced into each pixel; pixels without samples keep their history.
+	void accumulate(float* data, const float* samples);
+
+	bool hasHistory() const { return valid; }
+
+private:
+	std::vector<float> color, weight, depth;
+	std::vector<float> warpedColor, warpedWeight;
+	Camera prevCam;
+	bool valid;
+};
@@ -0,0 +1,63 @@
+#pragma once
+#include <vector>
+#include <cstddef>
+
+/*
+ * Where worker threads run and where their memory lives
+ *
+ * On machines with several sockets, a thread the scheduler moves to another
+ * socket keeps its memory on the old one and pays for every access across the
+ * interconnect. Pinned workers stay on one logical processor, and buffers made
+ * for them with NodeBuffer come from their own NUMA node.
+ */
+
+struct LogicalProcessor {
+	int group, number;	// Processor group and index within it, as Windows addresses it
+	int core;			// Physical core, shared by SMT siblings
+	int sibling;		// 0 for the first hardware thread of its core, 1 for the second...
+	int node;			// NUMA node
+};
+
+// Logical processors of the machine, one per core and node if the topology can't be read
+std::vector<LogicalProcessor> logicalProcessors();
+
+struct ThreadPlacement {
+	int threads = 0;	// Worker count, 0 for one per processor allowed by smt
+	bool smt = true;	// Use the second hardware thread of each core too
+	bool pin = false;	// Keep each worker on its processor
+};
+
+/*
+ * Applies a command line option to placement and returns true if it is one of:
+ *   --threads <n>       worker count
+ *   --smt <on|off>      run workers on both hardware threads of a core
+ *   --pin <on|off>      pin workers to logical processors
+ */
+bool parseThreadPlacement(const char* option, const char* value, ThreadPlacement& placement);
+
+// Processor of each worker: whole cores first, spread evenly over the nodes, then their SMT
+// siblings. Counts past the processors available wrap around.
+std::vector<LogicalProcessor> placeThreads(const ThreadPlacement& placement);
+
+// Restricts the calling thread to processor, returns false if the system refused
+bool pinThread(const LogicalProcessor& processor);
+
+// Page-aligned memory committed on a NUMA node, any node if node < 0. Zeroed when made.
+class NodeBuffer {
+public:
+	NodeBuffer() : memory(nullptr), bytes(0) {}
+	NodeBuffer(size_t bytes, int node);
+	~NodeBuffer();
+	NodeBuffer(NodeBuffer&& other) : memory(other.memory), bytes(other.bytes) { other.memory = nullptr, other.bytes = 0; }
+	NodeBuffer& operator=(NodeBuffer&& other);
+	NodeBuffer(const NodeBuffer&) = delete;
+	NodeBuffer& operator=(const NodeBuffer&) = delete;
+
+	template <typename T>
+	T* as() const { return static_cast<T*>(memory); }
+	size_t size() const { return bytes; }
+
+private:
+	void* memory;
+	size_t bytes;
+};
@@ -0,0 +1,80 @@
+#pragma once
+#include <cmath>
+#include "vec.hpp"
+
+#define DEG_TO_RAD 0.017453292519943295
+
+// Affine transform: a 3x3 linear part followed by a translation
+struct Transform {
+    double m[3][4];
+
+    Transform() {
+        for (int r = 0; r < 3; ++r)
+            for (int c = 0; c < 4; ++c)
+                m[r][c] = r == c ? 1 : 0;
+    }
+
+    // Scales, rotates about x, y then z (in degrees) and then translates
+    Transform(Vec pos, double scale, Vec rotation = Vec()) {
+        const double cx = cos(rotation.x * DEG_TO_RAD), sx = sin(rotation.x * DEG_TO_RAD);
+        const double cy = cos(rotation.y * DEG_TO_RAD), sy = sin(rotation.y * DEG_TO_RAD);
+        const double cz = cos(rotation.z * DEG_TO_RAD), sz = sin(rotation.z * DEG_TO_RAD);
+        const double r[3][3] = {
+            { cy * cz, sx * sy * cz - cx * sz, cx * sy * cz + sx * sz },
+            { cy * sz, sx * sy * sz + cx * cz, cx * sy * sz - sx * cz },
+            { -sy,     sx * cy,                cx * cy },
+        };
+        for (int i = 0; i < 3; ++i) {
+            for (int j = 0; j < 3; ++j) m[i][j] = r[i][j] * scale;
+        }
+        m[0][3] = pos.x, m[1][3] = pos.y, m[2][3] = pos.z;
+    }
+
+    Vec point(const Vec& p) const {
+        return Vec(m[0][0] * p.x + m[0][1] * p.y + m[0][2] * p.z + m[0][3],
+                   m[1][0] * p.x + m[1][1] * p.y + m[1][2] * p.z + m[1][3],
+                   m[2][0] * p.x + m[2][1] * p.y + m[2][2] * p.z + m[2][3]);
+    }
+
+    Vec vector(const Vec& v) const {
+        return Vec(m[0][0] * v.x + m[0][1] * v.y + m[0][2] * v.z,
+                   m[1][0] * v.x + m[1][1] * v.y + m[1][2] * v.z,
+                   m[2][0] * v.x + m[2][1] * v.y + m[2][2] * v.z);
+    }
+
+    // Multiplies by the transposed linear part; normals go to world space through the inverse transform's transpose
+    Vec transposed(const Vec& n) const {
+        return Vec(m[0][0] * n.x + m[1][0] * n.y + m[2][0] * n.z,
+                   m[0][1] * n.x + m[1][1] * n.y + m[2][1] * n.z,
+                   m[0][2] * n.x + m[1][2] * n.y + m[2][2] * n.z);
+    }
+
+    // Upper bound on how much the transform stretches any vector (Frobenius norm of the linear part)
+    double maxScale() const {
+        double s = 0;
+        for (int r = 0; r < 3; ++r)
+            for (int c = 0; c < 3; ++c)
+                s += m[r][c] * m[r][c];
+        return sqrt(s);
+    }
+
+    Transform inverse() const {
+        Transform inv;
+        const double det = m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1])
+                         - m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0])
+                         + m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0]);
+        const double f = 1.0 / det;
+        inv.m[0][0] = (m[1][1] * m[2][2] - m[1][2] * m[2][1]) * f;
+        inv.m[0][1] = (m[0][2] * m[2][1] - m[0][1] * m[2][2]) * f;
+        inv.m[0][2] = (m[0][1] * m[1][2] - m[0][2] * m[1][1]) * f;
+        inv.m[1][0] = (m[1][2] * m[2][0] - m[1][0] * m[2][2]) * f;
+        inv.m[1][1] = (m[0][0] * m[2][2] - m[0][2] * m[2][0]) * f;
+        inv.m[1][2] = (m[0][2] * m[1][0] - m[0][0] * m[1][2]) * f;
+        inv.m[2][0] = (m[1][0] * m[2][1] - m[1][1] * m[2][0]) * f;
+        inv.m[2][1] = (m[0][1] * m[2][0] - m[0][0] * m[2][1]) * f;
+        inv.m[2][2] = (m[0][0] * m[1][1] - m[0][1] * m[1][0]) * f;
+        Vec t = inv.vector(Vec(m[0][3], m[1][3], m[2][3]));
+        inv.m[0][3] = -t.x, inv.m[1][3] = -t.y, inv.m[2][3] = -t.z;
+        return inv;
+    }
+};
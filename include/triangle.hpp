@@ -4,7 +4,31 @@
 #include "brdf.hpp"
 #include "ray.hpp"
 
-struct Triangle : public Shape {
+/*
+ * Ray prepared for watertight triangle tests (Woop, Benthin and Wald 2013)
+ *
+ * The axes are permuted so that z is the dominant direction and vertices
+ * are sheared onto the ray, so each test reduces to 2D edge functions.
+ * Neighbouring triangles evaluate their shared edge with the same
+ * arithmetic, so a ray through an edge can never miss both.
+ */
+struct WatertightRay {
+	Vec o;
+	int kx, ky, kz;
+	double sx, sy, sz;
+
+	WatertightRay(const Ray& r);
+
+	// Returns the ray parameter of the hit, 0 if none
+	double intersect(const Vec& v0, const Vec& v1, const Vec& v2) const;
+};
+
+// Vertices of a mesh triangle packed for intersection, without the Shape around them
+struct TriangleVertices {
+	Vec v0, v1, v2;
+};
+
+struct Triangle final : public Shape {
 	Vec v0, v1, v2;
 	Vec n;
 
@@ -12,7 +36,9 @@ struct Triangle : public Shape {
 
 	double intersect(const Ray& r, Vec* point, Vec* normal) const override;
 
-	void sample(Vec& point, Vec& normal, double& pdf) const override;
+	void sample(Vec& point, Vec& normal, double& pdf, Sampler& sampler) const override;
+
+	AABB bounds() const override;
 
 	double area() const;
 };
\ No newline at end of file
@@ -0,0 +1,16 @@
+#pragma once
+
+/*
+ * Edge-aware spatial upscaling
+ *
+ * Joint bilateral upsampling: each full resolution pixel blends its four
+ * nearest low resolution pixels with bilinear weights, scaled down where the
+ * full resolution depth and normal at the low resolution pixel's center
+ * disagree with the pixel's own, so edges stay sharp.
+ */
+
+// src and dst are RGB, srcSamples and dstSamples hold the samples behind each pixel.
+// depth and normal are full resolution guides and may be null.
+void upscale(const float* src, const float* srcSamples, int srcWidth, int srcHeight,
+             float* dst, float* dstSamples, int width, int height,
+             const float* depth, const float* normal);
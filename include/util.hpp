@@ -1,25 +1,11 @@
 #pragma once
-#include <random>
-#include <omp.h>
+#include <cmath>
+#include <vector>
+#include <algorithm>
 #include "vec.hpp"
 #define PI 3.1415926535897932384626433832795
 
-/*
- * Thread-safe random number generator
- */
-
-struct RNG {
-    RNG();
-
-    void init(int nworkers);
-
-    double operator()();
-
-    std::uniform_real_distribution<double> distrb;
-    std::vector<std::mt19937> engines;
-};
-
-extern RNG rng;
+// All random numbers come from Sampler (see sampler.hpp), indexed by pixel and sample so renders repeat exactly
 
 /*
  * Utility functions
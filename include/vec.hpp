@@ -11,6 +11,7 @@ struct Vec {
     Vec operator+ (const Vec& b) const { return Vec(x + b.x, y + b.y, z + b.z); }
     Vec operator- (const Vec& b) const { return Vec(x - b.x, y - b.y, z - b.z); }
     Vec operator* (double b) const { return Vec(x * b, y * b, z * b); }
+    double operator[] (int axis) const { return axis == 0 ? x : axis == 1 ? y : z; }
     bool operator== (const Vec& b) const { return abs(x - b.x) < epsilon && abs(y - b.y) < epsilon && abs(z - b.z) < epsilon; }
 
     Vec mult(const Vec& b) const { return Vec(x * b.x, y * b.y, z * b.z); }
@@ -0,0 +1,123 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <cassert>
+#include <xmmintrin.h>
+#include <emmintrin.h>
+#include "bvh.hpp"
+
+/*
+ * Four-wide BVH with quantized child bounds, used for meshes
+ *
+ * Collapsed from a binary BVH. Each node stores its children's boxes as
+ * 8-bit offsets from the node's corner in steps of a power of two per axis,
+ * rounded outwards so they always contain the real boxes. One SSE pass then
+ * tests a ray against all four children.
+ *
+ * Leaves refer to primitives by their position in the source BVH's indices,
+ * so callers store their primitives in that order.
+ */
+
+struct WideNode {
+    float origin[3];            // Lower corner of the node
+    int8_t exponent[3];         // Quantization step per axis is 2^exponent
+    uint8_t numChildren;
+    uint8_t lo[3][4], hi[3][4]; // Child bounds per axis and child, in steps from origin
+    int child[4];               // Inner: node index. Leaf: ~(start << 3 | count)
+};
+
+class WideBVH {
+public:
+    std::vector<WideNode> nodes;
+
+    void build(const BVH& bvh);
+
+    /*
+     * Finds the closest hit within (0, tMax), as BVH::traverse. Adds the
+     * number of nodes visited to steps when given.
+     */
+    template <typename Intersect>
+    double traverse(const Ray& ray, double tMax, Intersect&& intersect, int* steps = nullptr) const {
+        if (nodes.empty()) return 0;
+        const float ox = static_cast<float>(ray.o.x), oy = static_cast<float>(ray.o.y), oz = static_cast<float>(ray.o.z);
+        const float ix = 1 / static_cast<float>(ray.d.x), iy = 1 / static_cast<float>(ray.d.y), iz = 1 / static_cast<float>(ray.d.z);
+        double closest = tMax;
+
+        // Every inner node pops its entry and pushes at most four, and collapsing never deepens the
+        // source tree, so 3 * BVH::maxDepth + 1 entries always do
+        struct Entry { int node; float t; };
+        Entry stack[3 * BVH::maxDepth + 1];
+        int size = 0;
+        stack[size++] = { 0, 0 };
+        while (size) {
+            const Entry entry = stack[--size];
+            if (entry.t >= closest) continue;
+            if (entry.node < 0) {
+                const int start = ~entry.node >> 3, count = ~entry.node & 7;
+                for (int i = start; i < start + count; ++i) {
+                    double d = intersect(i);
+                    if (d > 0 && d < closest) closest = d;
+                }
+                continue;
+            }
+            const WideNode& node = nodes[entry.node];
+            if (steps) ++*steps;
+
+            // Slab distances are q * step / d + (origin - o) / d for the quantized offsets q
+            __m128 tNear = _mm_setzero_ps();
+            __m128 tFar = _mm_set1_ps(static_cast<float>(closest));
+            slabs(node, 0, ox, ix, tNear, tFar);
+            slabs(node, 1, oy, iy, tNear, tFar);
+            slabs(node, 2, oz, iz, tNear, tFar);
+            // Widen by a few ulps so rounding in float cannot miss a box the ray grazes
+            tFar = _mm_mul_ps(tFar, _mm_set1_ps(1.00001f));
+            int hits = _mm_movemask_ps(_mm_cmple_ps(tNear, tFar)) & ((1 << node.numChildren) - 1);
+            if (!hits) continue;
+
+            // Push hit children far to near so the nearest is visited first
+            float t[4];
+            _mm_storeu_ps(t, tNear);
+            int order[4], numHits = 0;
+            for (int i = 0; i < 4; ++i) {
+                if (!(hits & (1 << i))) continue;
+                int j = numHits++;
+                while (j > 0 && t[order[j - 1]] < t[i]) {
+                    order[j] = order[j - 1];
+                    --j;
+                }
+                order[j] = i;
+            }
+            for (int i = 0; i < numHits; ++i) {
+                stack[size++] = { node.child[order[i]], t[order[i]] };
+            }
+            assert(size <= 3 * BVH::maxDepth + 1);
+        }
+        return closest < tMax ? closest : 0;
+    }
+
+private:
+    int collapse(const BVH& bvh, int binaryNode);
+
+    static void slabs(const WideNode& node, int axis, float o, float invDir, __m128& tNear, __m128& tFar) {
+        int bits = (node.exponent[axis] + 127) << 23;
+        float step;
+        memcpy(&step, &bits, sizeof(step));
+        const __m128 scale = _mm_set1_ps(step * invDir);
+        const __m128 offset = _mm_set1_ps((node.origin[axis] - o) * invDir);
+        const __m128 t0 = _mm_add_ps(_mm_mul_ps(unpack(node.lo[axis]), scale), offset);
+        const __m128 t1 = _mm_add_ps(_mm_mul_ps(unpack(node.hi[axis]), scale), offset);
+        // SSE min and max return the second operand on NaN, which rays parallel to the slab produce
+        tNear = _mm_max_ps(_mm_min_ps(t0, t1), tNear);
+        tFar = _mm_min_ps(_mm_max_ps(t0, t1), tFar);
+    }
+
+    // Four bytes to four floats
+    static __m128 unpack(const uint8_t* q) {
+        int packed;
+        memcpy(&packed, q, sizeof(packed));
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i words = _mm_unpacklo_epi8(_mm_cvtsi32_si128(packed), zero);
+        return _mm_cvtepi32_ps(_mm_unpacklo_epi16(words, zero));
+    }
+};
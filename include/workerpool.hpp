@@ -0,0 +1,59 @@
+#pragma once
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include "topology.hpp"
+
+/*
+ * Threads started once and reused for every frame
+ *
+ * run() hands the same job to every worker and returns at once, so the
+ * caller can keep pumping window messages while polling done(), or block in
+ * wait(). Jobs are passed by reference and must outlive the run, which keeps
+ * starting one free of heap allocations.
+ *
+ * The workers take the processors placeThreads picks for the placement, and
+ * stay on them if it pins them.
+ */
+class WorkerPool {
+public:
+    explicit WorkerPool(const ThreadPlacement& placement);
+    ~WorkerPool();
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    int size() const { return static_cast<int>(threads.size()); }
+
+    // Calls job(worker) on every thread, worker in [0, size())
+    template <typename Job>
+    void run(Job& job) {
+        start(&job, [](void* job, int worker) { (*static_cast<Job*>(job))(worker); });
+    }
+
+    bool done() const { return finished.load() == size(); }
+    void wait();
+
+    // NUMA node a pinned worker runs on, -1 if it may run anywhere
+    int node(int worker) const { return pinned ? processors[worker].node : -1; }
+
+    // Processors of the workers and whether they are pinned there
+    const std::vector<LogicalProcessor>& placement() const { return processors; }
+    bool isPinned() const { return pinned; }
+
+private:
+    std::vector<std::thread> threads;
+    std::vector<LogicalProcessor> processors;
+    bool pinned;
+    std::mutex mutex;
+    std::condition_variable wake, idle;
+    void* job;
+    void (*call)(void* job, int worker);
+    unsigned generation;    // Bumped by every run so workers can tell a new job from a spurious wakeup
+    bool stopping;
+    std::atomic<int> finished;
+
+    void start(void* job, void (*call)(void*, int));
+    void workerLoop(int worker);
+};
@@ -0,0 +1,101 @@
+#pragma once
+#include "accumulator.hpp"
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+
+// First line of a saved accumulator, the resolution follows on the second
+static const char* const magic = "ACCUMULATOR 1";
+
+Accumulator::Accumulator(int w, int h)
+    : width(w), height(h), sum(w * h * 3), compensation(w * h * 3), count(w * h) {}
+
+void Accumulator::clear() {
+    std::fill(sum.begin(), sum.end(), 0.0f);
+    std::fill(compensation.begin(), compensation.end(), 0.0f);
+    std::fill(count.begin(), count.end(), 0u);
+}
+
+// Kahan summation: compensation holds what the last addition rounded off, negated
+static void addCompensated(float& sum, float& compensation, float value) {
+    const float y = value - compensation;
+    const float t = sum + y;
+    compensation = (t - sum) - y;
+    sum = t;
+}
+
+void Accumulator::add(const float* frame, const float* samples, float scale) {
+    for (int i = 0; i < width * height; ++i) {
+        if (samples[i] <= 0) continue;
+        for (int k = 0; k < 3; ++k) {
+            addCompensated(sum[i * 3 + k], compensation[i * 3 + k], frame[i * 3 + k] * samples[i] * scale);
+        }
+        count[i] += static_cast<uint32_t>(samples[i]);
+    }
+}
+
+void Accumulator::merge(const Accumulator& other) {
+    for (int i = 0; i < width * height; ++i) {
+        for (int k = 0; k < 3; ++k) {
+            addCompensated(sum[i * 3 + k], compensation[i * 3 + k], other.sum[i * 3 + k] - other.compensation[i * 3 + k]);
+        }
+        count[i] += other.count[i];
+    }
+}
+
+void Accumulator::resolve(float* rgb) const {
+    for (int i = 0; i < width * height; ++i) {
+        const float inverse = count[i] > 0 ? 1.0f / count[i] : 0.0f;
+        for (int k = 0; k < 3; ++k) {
+            rgb[i * 3 + k] = (sum[i * 3 + k] - compensation[i * 3 + k]) * inverse;
+        }
+    }
+}
+
+bool Accumulator::save(const std::string& path) const {
+    std::ofstream file(path, std::ios::binary);
+    if (!file) {
+        std::cerr << "Error opening file: " << path << "\n";
+        return false;
+    }
+    return write(file);
+}
+
+bool Accumulator::load(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        std::cerr << "Error opening file: " << path << "\n";
+        return false;
+    }
+    return read(file, path);
+}
+
+bool Accumulator::write(std::ostream& out) const {
+    out << magic << "\n" << width << " " << height << "\n";
+    out.write(reinterpret_cast<const char*>(sum.data()), sum.size() * sizeof(float));
+    out.write(reinterpret_cast<const char*>(compensation.data()), compensation.size() * sizeof(float));
+    out.write(reinterpret_cast<const char*>(count.data()), count.size() * sizeof(uint32_t));
+    return static_cast<bool>(out);
+}
+
+bool Accumulator::read(std::istream& in, const std::string& name) {
+    std::string line;
+    int w, h;
+    if (!std::getline(in, line) || line != magic || !(in >> w >> h) || in.get() != '\n') {
+        std::cerr << name << ": not a saved accumulator\n";
+        return false;
+    }
+    if (w != width || h != height) {
+        std::cerr << name << ": accumulated at " << w << "x" << h << ", expected " << width << "x" << height << "\n";
+        return false;
+    }
+    in.read(reinterpret_cast<char*>(sum.data()), sum.size() * sizeof(float));
+    in.read(reinterpret_cast<char*>(compensation.data()), compensation.size() * sizeof(float));
+    in.read(reinterpret_cast<char*>(count.data()), count.size() * sizeof(uint32_t));
+    if (!in) {
+        std::cerr << name << ": truncated\n";
+        clear();
+        return false;
+    }
+    return true;
+}
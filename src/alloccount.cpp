@@ -0,0 +1,29 @@
+#pragma once
+#include "alloccount.hpp"
+
+#ifdef _DEBUG
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+static std::atomic<long long> allocations(0);
+
+// Replaces the global allocation functions, the array and nothrow forms forward to these
+void* operator new(size_t size) {
+    ++allocations;
+    if (void* p = malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    free(p);
+}
+
+long long allocationCount() {
+    return allocations.load();
+}
+#else
+long long allocationCount() {
+    return 0;
+}
+#endif
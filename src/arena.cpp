@@ -0,0 +1,45 @@
+#pragma once
+#include "arena.hpp"
+#include <cstdint>
+#include <algorithm>
+
+Arena::Arena(size_t blockSize) : blockSize(blockSize) {}
+
+Arena::~Arena() {
+    clear();
+    for (Block& block : blocks) {
+        ::operator delete(block.data);
+    }
+}
+
+void* Arena::allocate(size_t size, size_t align) {
+    if (!blocks.empty()) {
+        Block& block = blocks.back();
+        const uintptr_t base = reinterpret_cast<uintptr_t>(block.data);
+        const size_t offset = static_cast<size_t>((base + block.used + align - 1) / align * align - base);
+        if (offset + size <= block.size) {
+            block.used = offset + size;
+            return block.data + offset;
+        }
+    }
+
+    // Oversized requests get a block of their own
+    const size_t newSize = std::max(blockSize, size + align);
+    Block block = { static_cast<char*>(::operator new(newSize)), newSize, 0 };
+    blocks.push_back(block);
+    return allocate(size, align);
+}
+
+void Arena::clear() {
+    for (auto it = destructors.rbegin(); it != destructors.rend(); ++it) {
+        it->destroy(it->object);
+    }
+    destructors.clear();
+    for (size_t i = 1; i < blocks.size(); ++i) {
+        ::operator delete(blocks[i].data);
+    }
+    if (!blocks.empty()) {
+        blocks.resize(1);
+        blocks[0].used = 0;
+    }
+}
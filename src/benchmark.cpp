@@ -0,0 +1,996 @@
+#pragma once
+#include "benchmark.hpp"
+#include "scene.hpp"
+#include "pathtracer.hpp"
+#include "accumulator.hpp"
+#include "workerpool.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <chrono>
+#include <sstream>
+#include <thread>
+#include <algorithm>
+
+typedef std::chrono::high_resolution_clock Clock;
+
+static double millisecondsSince(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+static int intArg(int argc, char* argv[], int i, int fallback) {
+    return i < argc ? atoi(argv[i]) : fallback;
+}
+
+// Times a batch of rays through the scene from a grid of points above the floor
+static double traceRays(const Scene& scene, int count, Sampler& sampler) {
+    auto start = Clock::now();
+    for (int i = 0; i < count; ++i) {
+        sampler.startPixelSample(i, 0, 0);
+        double u1, u2, u3, u4;
+        sampler.get2D(u1, u2);
+        sampler.get2D(u3, u4);
+        Vec o(u1 * 100 - 50, 20, u2 * 100 - 50);
+        Vec d(u3 - 0.5, -1, u4 - 0.5);
+        double t;
+        int id;
+        scene.intersect(Ray(o, d.normalize()), t, id, 0, 0);
+    }
+    return millisecondsSince(start);
+}
+
+static int benchRefit(int argc, char* argv[]) {
+    const int count = intArg(argc, argv, 0, 1000);
+    const int frames = intArg(argc, argv, 1, 100);
+    const int rays = 100000;
+
+    // A field of instances sharing one mesh
+    std::ostringstream desc;
+    desc << "diffuse white .75 .75 .75\nmesh cube rsrc/models/cube.stl\n";
+    const int side = static_cast<int>(std::ceil(std::sqrt(static_cast<double>(count))));
+    for (int i = 0; i < count; ++i) {
+        desc << "instance white cube " << (i % side) * 3.0 - side * 1.5 << " 1 " << (i / side) * 3.0 - side * 1.5 << " 1\n";
+    }
+    std::istringstream in(desc.str());
+    Scene scene;
+    if (!scene.load(in, "refit benchmark")) return 1;
+
+    Sampler sampler;
+    printf("%d instances, %d frames, %d rays per frame\n", count, frames, rays);
+    printf("frame  update ms  full build ms  SAH cost ratio  trace ms\n");
+
+    double totalUpdate = 0, totalBuild = 0;
+    const double initialCost = scene.bvh.cost();
+    for (int frame = 1; frame <= frames; ++frame) {
+        // Every instance drifts on its own circle
+        for (int i = 0; i < count; ++i) {
+            double phase = frame * 0.05 + i * 0.618;
+            Vec pos((i % side) * 3.0 - side * 1.5 + frame * 0.02 * std::cos(phase) * (i % 7),
+                    1 + std::sin(phase),
+                    (i / side) * 3.0 - side * 1.5 + frame * 0.02 * std::sin(phase) * (i % 5));
+            scene.setTransform(i, Transform(pos, 1, Vec(0, frame * 2.0 + i, 0)));
+        }
+        scene.update();
+        totalUpdate += scene.lastUpdateTime;
+
+        // What rebuilding from scratch would have cost instead
+        std::vector<AABB> bounds;
+        for (const Shape* shape : scene.shapes) bounds.push_back(shape->bounds());
+        auto start = Clock::now();
+        BVH rebuilt;
+        rebuilt.build(bounds);
+        double buildTime = millisecondsSince(start);
+        totalBuild += buildTime;
+
+        if (frame % 10 == 0 || frame == 1) {
+            printf("%5d  %9.3f  %13.3f  %14.2f  %8.1f\n", frame, scene.lastUpdateTime, buildTime,
+                scene.bvh.cost() / initialCost, traceRays(scene, rays, sampler));
+        }
+    }
+    printf("average update %.3f ms (%d refits, %d rebuilds), average full build %.3f ms\n",
+        totalUpdate / frames, scene.refits, scene.rebuilds, totalBuild / frames);
+    return 0;
+}
+
+// Triangle bounds of a UV sphere with about count triangles, standing in for a dense scan
+static std::vector<AABB> sphereTriangles(int count) {
+    const int rings = std::max(2, static_cast<int>(std::sqrt(count / 4.0)));
+    const int segments = std::max(3, count / (2 * rings));
+    auto point = [&](int ring, int segment) {
+        double theta = PI * ring / rings, phi = 2 * PI * segment / segments;
+        return Vec(std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi));
+    };
+    std::vector<AABB> bounds;
+    bounds.reserve(2 * rings * segments);
+    for (int r = 0; r < rings; ++r) {
+        for (int s = 0; s < segments; ++s) {
+            Vec a = point(r, s), b = point(r + 1, s), c = point(r + 1, s + 1), d = point(r, s + 1);
+            AABB lower, upper;
+            lower.expand(a), lower.expand(b), lower.expand(c);
+            upper.expand(a), upper.expand(c), upper.expand(d);
+            bounds.push_back(lower);
+            bounds.push_back(upper);
+        }
+    }
+    return bounds;
+}
+
+static int benchBuild(int argc, char* argv[]) {
+    const int maxTriangles = intArg(argc, argv, 0, 4000000);
+    const int maxThreads = intArg(argc, argv, 1, std::max(1, static_cast<int>(std::thread::hardware_concurrency())));
+
+    printf("triangles  threads  build ms  speedup  SAH cost\n");
+    for (int count = 10000; count <= maxTriangles; count *= 10) {
+        std::vector<AABB> bounds = sphereTriangles(count);
+        double serialTime = 0;
+        for (int threads = 1; ; threads = std::min(threads * 2, maxThreads)) {
+            // Best of three to keep thread start-up noise out
+            double best = 1e300;
+            BVH bvh;
+            for (int run = 0; run < 3; ++run) {
+                auto start = Clock::now();
+                bvh.build(bounds, threads);
+                best = std::min(best, millisecondsSince(start));
+            }
+            if (threads == 1) serialTime = best;
+            printf("%9d  %7d  %8.2f  %7.2f  %8.2f\n", static_cast<int>(bounds.size()), threads, best, serialTime / best, bvh.cost());
+            if (threads == maxThreads) break;
+        }
+        if (count < maxTriangles && count * 10 > maxTriangles) count = maxTriangles / 10;
+    }
+    return 0;
+}
+
+static int benchWide(int argc, char* argv[]) {
+    const char* path = argc > 0 ? argv[0] : "rsrc/models/charizard.stl";
+    const int rays = intArg(argc, argv, 1, 1000000);
+    STLModel model(path);
+    const int numTriangles = static_cast<int>(model.triangles.size());
+    if (!numTriangles) return 1;
+
+    std::vector<AABB> bounds(numTriangles);
+    for (int i = 0; i < numTriangles; ++i) {
+        bounds[i] = model.triangles[i].bounds();
+    }
+    BVH binary;
+    binary.build(bounds);
+
+    // Rays from a sphere around the model towards points inside its box
+    std::vector<Ray> batch;
+    batch.reserve(rays);
+    Sampler sampler;
+    const Vec size = model.box.extent();
+    for (int i = 0; i < rays; ++i) {
+        sampler.startPixelSample(i, 1, 0);
+        double u1, u2, u3, u4;
+        sampler.get2D(u1, u2);
+        sampler.get2D(u3, u4);
+        double z = 1 - 2 * u1, r = std::sqrt(std::max(0.0, 1 - z * z)), phi = 2 * PI * u2;
+        Vec o = Vec(r * std::cos(phi), z, r * std::sin(phi)) * (2 * model.radius);
+        Vec target = model.box.min + Vec(size.x * u3, size.y * u4, size.z * sampler.get1D());
+        batch.push_back(Ray(o, (target - o).normalize()));
+    }
+
+    printf("%s: %d triangles, %d rays\n", path, numTriangles, rays);
+    printf("         nodes  bytes/node  node bytes/tri  steps/ray  Mrays/s\n");
+    auto report = [&](const char* name, size_t numNodes, size_t nodeSize, long long steps, double time) {
+        printf("%-6s %8d  %10d  %14.1f  %9.1f  %7.2f\n", name, static_cast<int>(numNodes), static_cast<int>(nodeSize),
+            static_cast<double>(numNodes * nodeSize) / numTriangles, static_cast<double>(steps) / rays, rays / time / 1000);
+    };
+
+    long long binarySteps = 0, wideSteps = 0;
+    std::vector<double> binaryHits(rays), wideHits(rays);
+    auto start = Clock::now();
+    for (int i = 0; i < rays; ++i) {
+        int steps = 0;
+        const WatertightRay prepared(batch[i]);
+        binaryHits[i] = binary.traverse(batch[i], 1e20, [&](int prim) { return prepared.intersect(model.vertices[prim].v0, model.vertices[prim].v1, model.vertices[prim].v2); }, &steps);
+        binarySteps += steps;
+    }
+    report("binary", binary.nodes.size(), sizeof(BVHNode), binarySteps, millisecondsSince(start));
+
+    start = Clock::now();
+    for (int i = 0; i < rays; ++i) {
+        int steps = 0;
+        const WatertightRay prepared(batch[i]);
+        wideHits[i] = model.bvh.traverse(batch[i], 1e20, [&](int prim) { return prepared.intersect(model.vertices[prim].v0, model.vertices[prim].v1, model.vertices[prim].v2); }, &steps);
+        wideSteps += steps;
+    }
+    report("wide", model.bvh.nodes.size(), sizeof(WideNode), wideSteps, millisecondsSince(start));
+
+    int mismatches = 0;
+    for (int i = 0; i < rays; ++i) {
+        if (std::abs(binaryHits[i] - wideHits[i]) > 1e-9) ++mismatches;
+    }
+    printf("%d rays hit differently\n", mismatches);
+    return mismatches ? 1 : 0;
+}
+
+// The ray-triangle test Triangle used before the watertight one, kept to compare against
+static double mollerTrumbore(const Ray& ray, const TriangleVertices& tri) {
+    const Vec edge1 = tri.v1 - tri.v0, edge2 = tri.v2 - tri.v0;
+    const Vec h = ray.d.cross(edge2);
+    const double a = edge1.dot(h);
+    if (std::abs(a) < 1e-8) return 0;
+    const double f = 1.0 / a;
+    const Vec s = ray.o - tri.v0;
+    const double u = f * s.dot(h);
+    if (u < 0.0 || u > 1.0) return 0;
+    const Vec q = s.cross(edge1);
+    const double v = f * ray.d.dot(q);
+    if (v < 0.0 || u + v > 1.0) return 0;
+    const double t = f * edge2.dot(q);
+    return t > 1e-8 ? t : 0;
+}
+
+static int benchLeak(int argc, char* argv[]) {
+    const int rays = intArg(argc, argv, 0, 1000000);
+    int leaks = 0;
+    for (const char* path : { "rsrc/models/cube.stl", "rsrc/models/dodecahedron.stl" }) {
+        STLModel model(path);
+        if (model.vertices.empty()) return 1;
+        const int numTriangles = static_cast<int>(model.vertices.size());
+
+        // Rays from near the center through points on edges and corners, which a closed mesh must all stop
+        Sampler sampler;
+        std::vector<Ray> batch;
+        batch.reserve(rays);
+        for (int i = 0; i < rays; ++i) {
+            sampler.startPixelSample(i, 2, 0);
+            double u1, u2, u3, u4;
+            sampler.get2D(u1, u2);
+            sampler.get2D(u3, u4);
+            const TriangleVertices& tri = model.vertices[std::min(numTriangles - 1, static_cast<int>(u1 * numTriangles))];
+            const Vec corners[3] = { tri.v0, tri.v1, tri.v2 };
+            const int edge = std::min(2, static_cast<int>(u2 * 3));
+            const double along = i % 4 ? u3 : 0;
+            Vec target = corners[edge] * (1 - along) + corners[(edge + 1) % 3] * along;
+            Vec o = Vec(u3 - 0.5, u4 - 0.5, sampler.get1D() - 0.5) * (0.2 * model.radius);
+            batch.push_back(Ray(o, (target - o).normalize()));
+        }
+
+        // Every triangle against every ray so only the test itself is timed
+        auto run = [&](const char* name, bool watertight) {
+            int misses = 0;
+            auto start = Clock::now();
+            for (const Ray& ray : batch) {
+                const WatertightRay prepared(ray);
+                bool hit = false;
+                for (const TriangleVertices& tri : model.vertices) {
+                    if (watertight ? prepared.intersect(tri.v0, tri.v1, tri.v2) : mollerTrumbore(ray, tri)) hit = true;
+                }
+                if (!hit) ++misses;
+            }
+            const double time = millisecondsSince(start);
+            printf("  %-14s %8d leaks  %6.2f ns/test\n", name, misses, time * 1e6 / (static_cast<double>(rays) * numTriangles));
+            return misses;
+        };
+        printf("%s: %d triangles, %d rays through edges and corners\n", path, numTriangles, rays);
+        run("moller-trumbore", false);
+        leaks += run("watertight", true);
+    }
+    return leaks ? 1 : 0;
+}
+
+static int benchWalls(int argc, char* argv[]) {
+    const int rays = intArg(argc, argv, 0, 1000000);
+
+    // A closed box, each face built three ways
+    static const DiffuseBRDF wallBRDF(Vec(.75, .75, .75));
+    const Vec lo(-5, 0, -5), hi(5, 10, 15);
+    std::vector<Sphere> spheres;
+    std::vector<Plane> planes;
+    std::vector<Quad> quads;
+    spheres.reserve(6), planes.reserve(6), quads.reserve(6);
+    for (int face = 0; face < 6; ++face) {
+        const int axis = face / 2;
+        const double side = face % 2 ? 1 : -1;
+        const Vec n(axis == 0 ? -side : 0, axis == 1 ? -side : 0, axis == 2 ? -side : 0);   // Into the box
+        const Vec center = (lo + hi) * 0.5 + Vec(axis == 0, axis == 1, axis == 2).mult(hi - lo) * (0.5 * side);
+        const Vec size = hi - lo;
+        const Vec u = Vec((axis + 1) % 3 == 0, (axis + 1) % 3 == 1, (axis + 1) % 3 == 2).mult(size);
+        const Vec v = Vec((axis + 2) % 3 == 0, (axis + 2) % 3 == 1, (axis + 2) % 3 == 2).mult(size);
+        spheres.emplace_back(1e5, center - n * 1e5, Vec(), wallBRDF);
+        planes.emplace_back(center, n, Vec(), wallBRDF);
+        quads.emplace_back(center - u * 0.5 - v * 0.5, u, v, Vec(), wallBRDF);
+    }
+
+    // Exact distance to the box wall from a point inside it
+    auto exit = [&](const Ray& ray) {
+        double t = 1e300;
+        for (int axis = 0; axis < 3; ++axis) {
+            if (ray.d[axis] != 0) t = std::min(t, ((ray.d[axis] > 0 ? hi[axis] : lo[axis]) - ray.o[axis]) / ray.d[axis]);
+        }
+        return t;
+    };
+
+    // Primary rays from inside the box to points on its walls, half of them pulled close to an edge
+    Sampler sampler;
+    std::vector<Ray> batch;
+    batch.reserve(rays);
+    const Vec size = hi - lo;
+    for (int i = 0; i < rays; ++i) {
+        sampler.startPixelSample(i, 3, 0);
+        double u1, u2, u3, u4, u5, u6;
+        sampler.get2D(u1, u2);
+        sampler.get2D(u3, u4);
+        sampler.get2D(u5, u6);
+        Vec o = lo + Vec(0.1 + 0.8 * u1, 0.1 + 0.8 * u2, 0.1 + 0.8 * u3).mult(size);
+        const int face = std::min(5, static_cast<int>(u4 * 6));
+        double c[3] = { u5, u6, sampler.get1D() };
+        if (i % 2) c[(face / 2 + 1) % 3] = std::pow(10.0, -6 + 4 * sampler.get1D());
+        c[face / 2] = face % 2;
+        Vec target = lo + Vec(c[0], c[1], c[2]).mult(size);
+        batch.push_back(Ray(o, (target - o).normalize()));
+    }
+
+    printf("%d rays from inside a closed box to points on its walls, half within 1e-6..1e-2 of an edge,\n", rays);
+    printf("then one diffuse bounce from each hit point. A ray leaks if it misses or ends more than 0.1 beyond the\n");
+    printf("box, which sphere walls only bow out of by 6e-4. Off surface is the distance of hits from their wall.\n");
+    printf("walls    ns/ray  leaked primary  leaked bounce  self-hits  mean off surface  max off surface\n");
+    auto run = [&](const char* name, auto& walls, auto offSurface) {
+        auto closest = [&](const Ray& ray, double& t, Vec& x, Vec& n) {
+            t = 0;
+            int hit = -1;
+            Vec pos, norm;
+            for (int i = 0; i < 6; ++i) {
+                double d = walls[i].intersect(ray, &pos, &norm);
+                if (d && (!t || d < t)) {
+                    t = d, hit = i, x = pos, n = norm;
+                }
+            }
+            return hit;
+        };
+
+        std::vector<double> hitT(rays);
+        std::vector<int> hitWall(rays);
+        std::vector<Vec> hitPoint(rays), hitNormal(rays);
+        auto start = Clock::now();
+        for (int i = 0; i < rays; ++i) {
+            hitWall[i] = closest(batch[i], hitT[i], hitPoint[i], hitNormal[i]);
+        }
+        const double time = millisecondsSince(start);
+
+        int leakedPrimary = 0, leakedBounce = 0, selfHits = 0, hits = 0;
+        double meanOff = 0, maxOff = 0;
+        for (int i = 0; i < rays; ++i) {
+            if (hitWall[i] < 0 || hitT[i] > exit(batch[i]) + 0.1) ++leakedPrimary;
+            if (hitWall[i] < 0) continue;
+
+            const Vec& x = hitPoint[i];
+            const double off = offSurface(walls[hitWall[i]], x);
+            meanOff += off;
+            maxOff = std::max(maxOff, off);
+            ++hits;
+
+            // Cosine weighted bounce back into the box
+            sampler.startPixelSample(i, 4, 0);
+            double r1, r2;
+            sampler.get2D(r1, r2);
+            Vec w = hitNormal[i];
+            if (w.dot(batch[i].d) > 0) w = w * -1.0;
+            Vec a = std::abs(w.x) > .1 ? Vec(0, 1, 0) : Vec(1, 0, 0);
+            Vec u = a.cross(w).normalize(), v = w.cross(u);
+            double phi = 2 * PI * r1, r = std::sqrt(r2);
+            Ray bounce(x, (u * (std::cos(phi) * r) + v * (std::sin(phi) * r) + w * std::sqrt(1 - r2)).normalize());
+            double t;
+            Vec x2, n2;
+            int next = closest(bounce, t, x2, n2);
+            if (next == hitWall[i]) ++selfHits;
+            else if (next < 0 || t > exit(bounce) + 0.1) ++leakedBounce;
+        }
+        printf("%-7s %7.1f  %14d  %13d  %9d  %16.2g  %15.2g\n", name, time * 1e6 / rays, leakedPrimary, leakedBounce, selfHits,
+            meanOff / std::max(1, hits), maxOff);
+    };
+    run("spheres", spheres, [](const Sphere& s, const Vec& x) { return std::abs((x - s.p).length() - s.rad); });
+    run("planes", planes, [](const Plane& p, const Vec& x) { return std::abs(p.n.dot(x - p.p)); });
+    run("quads", quads, [](const Quad& q, const Vec& x) { return std::abs(q.n.dot(x - q.corner)); });
+    return 0;
+}
+
+static int benchDispatch(int argc, char* argv[]) {
+    const int rays = intArg(argc, argv, 0, 20000);
+
+    // Spheres and quads mixed in file order, half of them mirrors
+    std::ostringstream desc;
+    desc << "diffuse white .75 .75 .75\nspecular mirror .9 .9 .9\n";
+    Sampler sampler;
+    for (int i = 0; i < 1000; ++i) {
+        sampler.startPixelSample(i, 5, 0);
+        double u1, u2, u3, u4;
+        sampler.get2D(u1, u2);
+        sampler.get2D(u3, u4);
+        const char* material = i % 4 < 2 ? "white" : "mirror";
+        if (i % 2) desc << "sphere " << material << " 0.2 " << u1 * 20 - 10 << " " << u2 * 20 - 10 << " " << u3 * 20 - 10 << "\n";
+        else desc << "quad " << material << " " << u1 * 20 - 10 << " " << u2 * 20 - 10 << " " << u3 * 20 - 10 << " 0.3 0 " << u4 * .3 << " 0 0.3 0\n";
+    }
+    std::istringstream in(desc.str());
+    Scene scene;
+    if (!scene.load(in, "dispatch benchmark")) return 1;
+
+    std::vector<Ray> batch;
+    batch.reserve(rays);
+    for (int i = 0; i < rays; ++i) {
+        sampler.startPixelSample(i, 6, 0);
+        double u1, u2, u3, u4;
+        sampler.get2D(u1, u2);
+        sampler.get2D(u3, u4);
+        double z = 1 - 2 * u1, r = std::sqrt(std::max(0.0, 1 - z * z)), phi = 2 * PI * u2;
+        batch.push_back(Ray(Vec(u3 * 20 - 10, u4 * 20 - 10, 0), Vec(r * std::cos(phi), z, r * std::sin(phi))));
+    }
+    const size_t numShapes = scene.shapes.size();
+    printf("%d rays against %d shapes each, then shading at every shape\n", rays, static_cast<int>(numShapes));
+    printf("          intersect ns  eval+sample ns  checksum\n");
+
+    // Every ray against every shape, so the dispatch is in the innermost loop
+    auto run = [&](const char* name, auto intersect, auto shade) {
+        double checksum = 0;
+        Vec pos, norm;
+        auto start = Clock::now();
+        for (const Ray& ray : batch) {
+            for (const Shape* shape : scene.shapes) {
+                checksum += intersect(*shape, ray, pos, norm);
+            }
+        }
+        const double intersectTime = millisecondsSince(start);
+
+        start = Clock::now();
+        Sampler shadeSampler;
+        for (int i = 0; i < rays; ++i) {
+            shadeSampler.startPixelSample(i, 7, 0);
+            const Vec n(0, 1, 0), o = batch[i].d.y > 0 ? batch[i].d : batch[i].d * -1.0;
+            for (const Shape* shape : scene.shapes) {
+                Vec w;
+                double pdf;
+                checksum += shade(shape->brdf, n, o, w, pdf, shadeSampler).x;
+            }
+        }
+        const double shadeTime = millisecondsSince(start);
+        const double tests = static_cast<double>(rays) * numShapes;
+        printf("%-8s  %12.2f  %14.2f  %.6g\n", name, intersectTime * 1e6 / tests, shadeTime * 1e6 / tests, checksum);
+    };
+    run("virtual",
+        [](const Shape& shape, const Ray& ray, Vec& pos, Vec& norm) { return shape.intersect(ray, &pos, &norm); },
+        [](const BRDF& brdf, const Vec& n, const Vec& o, Vec& w, double& pdf, Sampler& sampler) {
+            brdf.sample(n, o, w, pdf, sampler);
+            return brdf.eval(n, o, w);
+        });
+
+    // Closest hits through one hierarchy over all shapes, or through one per type whose leaves need no dispatch
+    std::vector<AABB> bounds, sphereBounds, quadBounds;
+    std::vector<const Sphere*> spheres;
+    std::vector<const Quad*> quads;
+    for (const Shape* shape : scene.shapes) {
+        bounds.push_back(shape->bounds());
+        if (const Sphere* sphere = dynamic_cast<const Sphere*>(shape)) {
+            spheres.push_back(sphere);
+            sphereBounds.push_back(shape->bounds());
+        }
+        else {
+            quads.push_back(static_cast<const Quad*>(shape));
+            quadBounds.push_back(shape->bounds());
+        }
+    }
+    BVH mixed, sphereBVH, quadBVH;
+    mixed.build(bounds);
+    sphereBVH.build(sphereBounds);
+    quadBVH.build(quadBounds);
+
+    printf("\n          closest hit ns  checksum\n");
+    auto trace = [&](const char* name, auto closest) {
+        double checksum = 0;
+        auto start = Clock::now();
+        for (const Ray& ray : batch) {
+            double t = 1e20;
+            closest(ray, t);
+            if (t < 1e20) checksum += t;
+        }
+        printf("%-8s  %14.2f  %.6g\n", name, millisecondsSince(start) * 1e6 / rays, checksum);
+    };
+    auto traverse = [](const BVH& bvh, const Ray& ray, double& t, auto intersect) {
+        Vec pos, norm;
+        bvh.traverse(ray, t, [&](int i) {
+            double d = intersect(i, pos, norm);
+            if (d && d < t) t = d;
+            return d;
+        });
+    };
+    trace("one BVH", [&](const Ray& ray, double& t) {
+        traverse(mixed, ray, t, [&](int i, Vec& pos, Vec& norm) { return scene.shapes[i]->intersect(ray, &pos, &norm); });
+    });
+    trace("per type", [&](const Ray& ray, double& t) {
+        traverse(sphereBVH, ray, t, [&](int i, Vec& pos, Vec& norm) { return spheres[i]->intersect(ray, &pos, &norm); });
+        traverse(quadBVH, ray, t, [&](int i, Vec& pos, Vec& norm) { return quads[i]->intersect(ray, &pos, &norm); });
+    });
+    return 0;
+}
+
+static int benchKernels(int argc, char* argv[]) {
+    const char* path = argc > 0 ? argv[0] : "rsrc/scenes/cornell.scene";
+    const int spp = intArg(argc, argv, 1, 4);
+    Scene scene;
+    if (!scene.load(path)) return 1;
+
+    // One thread over the whole frame, so only the kernel differs between runs
+    const int width = 160, height = 120;
+    std::vector<float> data(width * height * 3);
+    Camera camera(scene.cameraPos.x, scene.cameraPos.y, scene.cameraPos.z);
+    struct Variant {
+        const char* name;
+        unsigned features;
+    };
+    const Variant variants[] = {
+        { "preview", KernelPreview | KernelNextEvent },
+        { "preview, mirrors", KernelPreview | KernelNextEvent | KernelSpecular },
+        { "full", KernelNextEvent },
+        { "full, mirrors", KernelNextEvent | KernelSpecular },
+        { "no NEE", 0 },
+        { "no NEE, mirrors", KernelSpecular },
+    };
+    printf("%s at %dx%d, %d spp on one thread%s\n", path, width, height, spp,
+        scene.hasSpecular ? ", kernels without mirrors skipped as the scene has some" : "");
+    printf("kernel             ms      Msamples/s  mean\n");
+    const unsigned environment = scene.environment.empty() ? 0 : KernelEnvironment;
+    for (const Variant& variant : variants) {
+        if (scene.hasSpecular && !(variant.features & KernelSpecular)) continue;
+        std::fill(data.begin(), data.end(), 0.0f);
+        Sampler sampler;
+        auto start = Clock::now();
+        tileKernel(variant.features | environment)(scene, RenderSettings(), data.data(), width * 3, width, height, spp, 0, 0, 0, width, height, camera, sampler);
+        const double time = millisecondsSince(start);
+        double mean = 0;
+        for (float v : data) mean += v;
+        printf("%-16s  %9.1f  %10.3f  %.6f\n", variant.name, time, width * height * spp / (time * 1e3), mean / data.size());
+    }
+    return 0;
+}
+
+// White versions of every material, for the furnace
+struct NamedBRDF {
+    const char* name;
+    const BRDF* brdf;
+};
+
+static int benchFurnace(int argc, char* argv[]) {
+    const int samples = intArg(argc, argv, 0, 100000);
+    const Vec white(1, 1, 1);
+    const DiffuseBRDF diffuse(white);
+    const SpecularBRDF mirror(white);
+    const ConductorBRDF metal1(white, 0.1), metal5(white, 0.5), metal10(white, 1);
+    const PlasticBRDF plastic(white, 0.3);
+    const DielectricBRDF glass(white);
+    const NamedBRDF materials[] = {
+        { "diffuse", &diffuse }, { "mirror", &mirror }, { "metal 0.1", &metal1 }, { "metal 0.5", &metal5 },
+        { "metal 1.0", &metal10 }, { "plastic 0.3", &plastic }, { "glass", &glass },
+    };
+    const double angles[] = { 0, 45, 75, 89 };
+
+    // A white material lit evenly from everywhere reflects its directional albedo, at most one. The
+    // albedo is estimated with the material's own samples and, for all but delta materials, with
+    // cosine samples through eval; the two agree when sample and eval agree.
+    printf("%d samples per view angle, from the material and from the cosine through eval\n", samples);
+    printf("material     angle  sampled  stddev  eval     stddev\n");
+    const Vec n(0, 0, 1);
+    for (const NamedBRDF& material : materials) {
+        for (int a = 0; a < 4; ++a) {
+            const double theta = angles[a] * PI / 180;
+            const Vec o(sin(theta), 0, cos(theta));
+            double sum[2] = {}, sumSq[2] = {};
+            Sampler sampler;
+            for (int k = 0; k < samples; ++k) {
+                sampler.startPixelSample(a, 8, k);
+                Vec i;
+                const double sampled = material.brdf->sampleWeight(n, o, i, sampler).x;
+                double u1, u2;
+                sampler.get2D(u1, u2);
+                const double r = sqrt(u1), phi = 2 * PI * u2;
+                const Vec cosine(r * cos(phi), r * sin(phi), sqrt(1 - u1));
+                const double evaluated = material.brdf->eval(n, o, cosine).x * PI;
+                sum[0] += sampled, sumSq[0] += sampled * sampled;
+                sum[1] += evaluated, sumSq[1] += evaluated * evaluated;
+            }
+            double mean[2], deviation[2];
+            for (int e = 0; e < 2; ++e) {
+                mean[e] = sum[e] / samples;
+                deviation[e] = sqrt(std::max(0.0, sumSq[e] / samples - mean[e] * mean[e]));
+            }
+            printf("%-11s  %5.0f  %7.4f  %6.3f", material.name, angles[a], mean[0], deviation[0]);
+            if (isDelta(material.brdf->type)) printf("  -        -\n");
+            else printf("  %7.4f  %6.3f\n", mean[1], deviation[1]);
+        }
+    }
+    return 0;
+}
+
+static int benchMaterials(int argc, char* argv[]) {
+    const int calls = intArg(argc, argv, 0, 1000000);
+    const DiffuseBRDF diffuse(Vec(.75, .75, .75));
+    const SpecularBRDF mirror(Vec(.9, .9, .9));
+    const ConductorBRDF metal(Vec(1, .78, .34), 0.3);
+    const PlasticBRDF plastic(Vec(.7, .1, .1), 0.3);
+    const DielectricBRDF glass(Vec(1, 1, 1));
+    const NamedBRDF materials[] = {
+        { "diffuse", &diffuse }, { "mirror", &mirror }, { "metal", &metal }, { "plastic", &plastic }, { "glass", &glass },
+    };
+
+    // Pairs of directions around varying normals, reused round robin
+    const int numDirections = 4096;
+    std::vector<Vec> normals(numDirections), outgoing(numDirections), incoming(numDirections);
+    Sampler sampler;
+    auto sphere = [&]() {
+        double u1, u2;
+        sampler.get2D(u1, u2);
+        double z = 1 - 2 * u1, r = sqrt(std::max(0.0, 1 - z * z)), phi = 2 * PI * u2;
+        return Vec(r * cos(phi), r * sin(phi), z);
+    };
+    for (int k = 0; k < numDirections; ++k) {
+        sampler.startPixelSample(k, 9, 0);
+        normals[k] = sphere();
+        outgoing[k] = sphere();
+        incoming[k] = sphere();
+        if (outgoing[k].dot(normals[k]) < 0) outgoing[k] = outgoing[k] * -1.0;
+        if (incoming[k].dot(normals[k]) < 0) incoming[k] = incoming[k] * -1.0;
+    }
+
+    printf("%d calls each through the vtable\n", calls);
+    printf("material  eval ns  sample ns  sampleWeight ns  checksum\n");
+    for (const NamedBRDF& material : materials) {
+        const BRDF& brdf = *material.brdf;
+        double checksum = 0;
+        auto start = Clock::now();
+        for (int k = 0; k < calls; ++k) {
+            const int d = k & (numDirections - 1);
+            checksum += brdf.eval(normals[d], outgoing[d], incoming[d]).x;
+        }
+        const double evalTime = millisecondsSince(start);
+
+        start = Clock::now();
+        for (int k = 0; k < calls; ++k) {
+            const int d = k & (numDirections - 1);
+            sampler.startPixelSample(d, 10, k);
+            Vec i;
+            double pdf;
+            brdf.sample(normals[d], outgoing[d], i, pdf, sampler);
+            checksum += pdf;
+        }
+        const double sampleTime = millisecondsSince(start);
+
+        start = Clock::now();
+        for (int k = 0; k < calls; ++k) {
+            const int d = k & (numDirections - 1);
+            sampler.startPixelSample(d, 10, k);
+            Vec i;
+            checksum += brdf.sampleWeight(normals[d], outgoing[d], i, sampler).x;
+        }
+        const double weightTime = millisecondsSince(start);
+        printf("%-8s  %7.1f  %9.1f  %15.1f  %.6g\n", material.name, evalTime * 1e6 / calls, sampleTime * 1e6 / calls, weightTime * 1e6 / calls, checksum);
+    }
+    return 0;
+}
+
+// Averages passes of a few samples each, from sample index offset on, for up to budget ms or spp samples
+static std::vector<float> renderPasses(const Scene& scene, const RenderSettings& settings, int width, int height, uint32_t offset, double budgetMs, int spp, int& taken) {
+    const int passSpp = 4;
+    Camera camera(scene.cameraPos.x, scene.cameraPos.y, scene.cameraPos.z);
+    const TileKernel kernel = tileKernel(kernelFeatures(scene, false, true));
+    std::vector<float> sum(width * height * 3), pass(width * height * 3);
+    Sampler sampler;
+    auto start = Clock::now();
+    taken = 0;
+    while (budgetMs > 0 ? millisecondsSince(start) < budgetMs : taken < spp) {
+        std::fill(pass.begin(), pass.end(), 0.0f);
+        kernel(scene, settings, pass.data(), width * 3, width, height, passSpp, offset + taken, 0, 0, width, height, camera, sampler);
+        for (size_t i = 0; i < sum.size(); ++i) sum[i] += pass[i];
+        taken += passSpp;
+    }
+    for (float& v : sum) v *= static_cast<float>(passSpp) / taken;
+    return sum;
+}
+
+// RMSE of image against reference, and the relative difference of their means
+static void imageError(const std::vector<float>& image, const std::vector<float>& reference, double& rmse, double& bias) {
+    double error = 0, mean = 0, referenceMean = 0;
+    for (size_t i = 0; i < image.size(); ++i) {
+        error += (image[i] - reference[i]) * (image[i] - reference[i]);
+        mean += image[i];
+        referenceMean += reference[i];
+    }
+    rmse = sqrt(error / image.size());
+    bias = referenceMean > 0 ? (mean - referenceMean) / referenceMean : 0;
+}
+
+static int benchFireflies(int argc, char* argv[]) {
+    const char* path = argc > 0 ? argv[0] : "rsrc/scenes/caustics.scene";
+    const int budget = intArg(argc, argv, 1, 2000);
+    const int referenceSpp = intArg(argc, argv, 2, 1024);
+    Scene scene;
+    if (!scene.load(path)) return 1;
+
+    const int width = 80, height = 60;
+    int taken;
+    auto start = Clock::now();
+    const std::vector<float> reference = renderPasses(scene, RenderSettings(), width, height, 1u << 20, 0, referenceSpp, taken);
+    double referenceMean = 0;
+    for (float v : reference) referenceMean += v;
+    referenceMean /= reference.size();
+    printf("%s at %dx%d, unclamped reference of %d spp in %.0f ms, mean %.5f\n", path, width, height, taken, millisecondsSince(start), referenceMean);
+    printf("each setting renders for %d ms\n", budget);
+    printf("max radiance  regularization  spp   rmse     bias\n");
+
+    struct Setting {
+        double maxRadiance, roughness;
+    };
+    const Setting settings[] = { { 0, 0 }, { 16, 0 }, { 4, 0 }, { 0, 0.2 }, { 0, 0.4 }, { 16, 0.2 }, { 4, 0.2 } };
+    for (const Setting& setting : settings) {
+        RenderSettings controls;
+        controls.maxBounceRadiance = setting.maxRadiance;
+        controls.regularization = setting.roughness;
+        const std::vector<float> image = renderPasses(scene, controls, width, height, 0, budget, 0, taken);
+        double rmse, bias;
+        imageError(image, reference, rmse, bias);
+        printf("%12g  %14g  %4d  %.5f  %+.2f%%\n", setting.maxRadiance, setting.roughness, taken, rmse, 100 * bias);
+    }
+    return 0;
+}
+
+static int benchRoulette(int argc, char* argv[]) {
+    const char* path = argc > 0 ? argv[0] : "rsrc/scenes/caustics.scene";
+    const int budget = intArg(argc, argv, 1, 2000);
+    const int referenceSpp = intArg(argc, argv, 2, 512);
+    Scene scene;
+    if (!scene.load(path)) return 1;
+
+    // The reference takes every path to the hard limit
+    const int width = 80, height = 60;
+    RenderSettings full;
+    full.maxDepth = full.rouletteDepth = maxPathBounces;
+    int taken;
+    auto start = Clock::now();
+    const std::vector<float> reference = renderPasses(scene, full, width, height, 1u << 20, 0, referenceSpp, taken);
+    printf("%s at %dx%d, reference of %d spp to depth %d without roulette in %.0f ms\n", path, width, height, taken, maxPathBounces, millisecondsSince(start));
+    printf("each setting renders for %d ms\n", budget);
+    printf("max depth  roulette depth  survival  spp   rmse     bias\n");
+
+    struct Setting {
+        int maxDepth, rouletteDepth;
+        double survival;
+    };
+    const Setting settings[] = {
+        { maxPathBounces, maxPathBounces, 1 }, { 4, maxPathBounces, 1 }, { 8, maxPathBounces, 1 },
+        { 16, 3, 0.95 }, { 16, 1, 0.95 }, { 16, 3, 0.5 }, { maxPathBounces, 3, 0.95 },
+    };
+    for (const Setting& setting : settings) {
+        RenderSettings controls;
+        controls.maxDepth = setting.maxDepth;
+        controls.rouletteDepth = setting.rouletteDepth;
+        controls.rouletteSurvival = setting.survival;
+        const std::vector<float> image = renderPasses(scene, controls, width, height, 0, budget, 0, taken);
+        double rmse, bias;
+        imageError(image, reference, rmse, bias);
+        printf("%9d  %14d  %8g  %4d  %.5f  %+.2f%%\n", setting.maxDepth, setting.rouletteDepth, setting.survival, taken, rmse, 100 * bias);
+    }
+    return 0;
+}
+
+static int benchAccumulation(int argc, char* argv[]) {
+    const int frames = intArg(argc, argv, 0, 1000000);
+    const int pixels = 64;
+
+    // One sample per pixel and frame, exponentially distributed about 0.5 so a few are much brighter
+    std::vector<float> frame(pixels * 3), ones(pixels, 1.0f), plain(pixels * 3), resolved(pixels * 3);
+    std::vector<double> exact(pixels * 3);
+    Accumulator accumulator(pixels, 1);
+    Sampler sampler;
+    for (int f = 0; f < frames; ++f) {
+        for (int i = 0; i < pixels; ++i) {
+            sampler.startPixelSample(i, 13, f);
+            for (int k = 0; k < 3; ++k) {
+                frame[i * 3 + k] = static_cast<float>(-0.5 * log(1 - sampler.get1D()));
+                exact[i * 3 + k] += frame[i * 3 + k];
+            }
+        }
+        for (int i = 0; i < pixels * 3; ++i) plain[i] += frame[i];
+        accumulator.add(frame.data(), ones.data(), 1);
+    }
+    accumulator.resolve(resolved.data());
+
+    double plainError = 0, kahanError = 0;
+    for (int i = 0; i < pixels * 3; ++i) {
+        const double mean = exact[i] / frames;
+        plainError = std::max(plainError, std::abs(plain[i] / frames - mean) / mean);
+        kahanError = std::max(kahanError, std::abs(resolved[i] - mean) / mean);
+    }
+
+    // Adding the last frame over again, apart from the sample generation
+    auto start = Clock::now();
+    for (int f = 0; f < frames; ++f) {
+        for (int i = 0; i < pixels * 3; ++i) plain[i] += frame[i];
+    }
+    const double plainTime = millisecondsSince(start);
+    start = Clock::now();
+    for (int f = 0; f < frames; ++f) accumulator.add(frame.data(), ones.data(), 1);
+    const double kahanTime = millisecondsSince(start);
+
+    printf("%d frames of 1 spp into %d pixels, largest relative error of the mean against double sums\n", frames, pixels);
+    printf("summation  ns/pixel  error\n");
+    printf("float      %8.2f  %.2e\n", plainTime * 1e6 / (static_cast<double>(frames) * pixels), plainError);
+    printf("kahan      %8.2f  %.2e\n", kahanTime * 1e6 / (static_cast<double>(frames) * pixels), kahanError);
+    return 0;
+}
+
+static int benchLights(int argc, char* argv[]) {
+    const char* path = argc > 0 ? argv[0] : "rsrc/scenes/dusk.scene";
+    const int spp = intArg(argc, argv, 1, 256);
+    Scene scene;
+    if (!scene.load(path)) return 1;
+
+    // Light sampling must converge to what BRDF sampling alone finds, whatever the number of lights
+    const int width = 80, height = 60;
+    Camera camera(scene.cameraPos.x, scene.cameraPos.y, scene.cameraPos.z);
+    std::vector<float> data(width * height * 3);
+    printf("%s at %dx%d, %d spp, %d shape lights%s\n", path, width, height, spp, static_cast<int>(scene.lights.size()),
+        scene.environment.empty() ? "" : " and the environment");
+    printf("sampling        ms  mean\n");
+    double means[2];
+    for (int nextEvent = 1; nextEvent >= 0; --nextEvent) {
+        Sampler sampler;
+        auto start = Clock::now();
+        tileKernel(kernelFeatures(scene, false, nextEvent != 0))(scene, RenderSettings(), data.data(), width * 3, width, height, spp, 0, 0, 0, width, height, camera, sampler);
+        const double time = millisecondsSince(start);
+        double mean = 0;
+        for (float v : data) mean += v;
+        means[nextEvent] = mean / data.size();
+        printf("%-10s  %6.0f  %.5f\n", nextEvent ? "lights" : "BRDF only", time, means[nextEvent]);
+    }
+    printf("lights against BRDF only: %+.2f%%\n", means[0] > 0 ? 100 * (means[1] - means[0]) / means[0] : 0);
+    return 0;
+}
+
+static int benchScaling(int argc, char* argv[]) {
+    const char* path = argc > 0 ? argv[0] : "rsrc/scenes/cornell.scene";
+    const int spp = intArg(argc, argv, 1, 4);
+    const bool pin = argc <= 2 || strcmp(argv[2], "off") != 0;
+    const int tileSize = std::max(1, std::min(maxTileSize, intArg(argc, argv, 3, maxTileSize)));
+    Scene scene;
+    if (!scene.load(path)) return 1;
+
+    // Tiles handed out from a shared counter, as the interactive renderer does, traced either straight
+    // into the shared frame or into a buffer of the worker's own and committed with streaming stores
+    const int width = 480, height = 360;
+    const int tilesX = (width + tileSize - 1) / tileSize, numTiles = tilesX * ((height + tileSize - 1) / tileSize);
+    Camera camera(scene.cameraPos.x, scene.cameraPos.y, scene.cameraPos.z);
+    const TileKernel kernel = tileKernel(kernelFeatures(scene, false, true));
+    std::vector<float> data(width * height * 3);
+    std::vector<NodeBuffer> tileBuffers;
+    std::atomic<int> nextTile;
+    bool direct = false;
+    auto job = [&](int worker) {
+        Sampler sampler;
+        for (int tile = nextTile++; tile < numTiles; tile = nextTile++) {
+            const int startX = (tile % tilesX) * tileSize, startY = (tile / tilesX) * tileSize;
+            const int endX = std::min(width, startX + tileSize), endY = std::min(height, startY + tileSize);
+            if (direct) {
+                float* corner = data.data() + ((height - endY) * width + startX) * 3;
+                kernel(scene, RenderSettings(), corner, width * 3, width, height, spp, 0, startX, startY, endX, endY, camera, sampler);
+            }
+            else {
+                float* buffer = tileBuffers[worker].as<float>();
+                kernel(scene, RenderSettings(), buffer, maxTileSize * 3, width, height, spp, 0, startX, startY, endX, endY, camera, sampler);
+                commitTile(buffer, maxTileSize * 3, data.data(), width, height, startX, startY, endX, endY);
+            }
+        }
+    };
+
+    const std::vector<LogicalProcessor> processors = logicalProcessors();
+    int cores = 0, nodes = 0;
+    for (const LogicalProcessor& p : processors) {
+        cores = std::max(cores, p.core + 1);
+        nodes = std::max(nodes, p.node + 1);
+    }
+    printf("%s at %dx%d in %dx%d tiles, %d spp, %d logical processors on %d cores and %d NUMA nodes, %s\n", path, width, height,
+        tileSize, tileSize, spp, static_cast<int>(processors.size()), cores, nodes, pin ? "pinned" : "not pinned");
+    printf("threads  cores  nodes  direct ms  tiled ms  speedup  efficiency\n");
+
+    // Whole cores first, then their SMT siblings, see placeThreads. Speedup and efficiency are of the
+    // tiled frames against the tiled frame on one thread.
+    double serialTime = 0;
+    const int maxThreads = static_cast<int>(processors.size());
+    for (int threads = 1; ; threads = std::min(threads * 2, maxThreads)) {
+        ThreadPlacement placement;
+        placement.threads = threads;
+        placement.pin = pin;
+        WorkerPool workers(placement);
+        std::vector<bool> coreUsed(cores), nodeUsed(nodes);
+        for (const LogicalProcessor& p : workers.placement()) coreUsed[p.core] = true, nodeUsed[p.node] = true;
+        tileBuffers.clear();
+        for (int worker = 0; worker < threads; ++worker) {
+            tileBuffers.emplace_back(maxTileSize * maxTileSize * 3 * sizeof(float), workers.node(worker));
+        }
+
+        // Best of three, the first also warms the caches
+        double best[2] = { 1e300, 1e300 };
+        for (int run = 0; run < 6; ++run) {
+            direct = run % 2 == 0;
+            nextTile.store(0);
+            auto start = Clock::now();
+            workers.run(job);
+            workers.wait();
+            best[direct] = std::min(best[direct], millisecondsSince(start));
+        }
+        if (threads == 1) serialTime = best[0];
+        printf("%7d  %5d  %5d  %9.1f  %8.1f  %7.2f  %9.0f%%\n", threads, static_cast<int>(std::count(coreUsed.begin(), coreUsed.end(), true)),
+            static_cast<int>(std::count(nodeUsed.begin(), nodeUsed.end(), true)), best[1], best[0], serialTime / best[0], 100 * serialTime / best[0] / threads);
+        if (threads == maxThreads) break;
+    }
+    return 0;
+}
+
+static int benchEnvironment(int argc, char* argv[]) {
+    const char* path = argc > 0 ? argv[0] : "rsrc/environments/sky.pfm";
+    const int samples = intArg(argc, argv, 1, 1000000);
+    Environment environment;
+    auto start = Clock::now();
+    if (!environment.load(path)) return 1;
+    printf("%s: %dx%d loaded with its distribution in %.2f ms\n", path, environment.width, environment.height, millisecondsSince(start));
+
+    // Total luminance arriving from the whole sphere, estimated from uniform and from importance sampled directions
+    auto luminance = [](const Vec& c) { return 0.2126 * c.x + 0.7152 * c.y + 0.0722 * c.z; };
+    Sampler sampler;
+    double sum[2] = {}, sumSq[2] = {}, pdfSum = 0;
+    start = Clock::now();
+    for (int k = 0; k < samples; ++k) {
+        sampler.startPixelSample(0, 11, k);
+        double u1, u2;
+        sampler.get2D(u1, u2);
+        double z = 1 - 2 * u1, r = sqrt(std::max(0.0, 1 - z * z)), phi = 2 * PI * u2;
+        Vec d(r * cos(phi), z, r * sin(phi));
+        double value = luminance(environment.radiance(d)) * 4 * PI;
+        sum[0] += value, sumSq[0] += value * value;
+        pdfSum += environment.pdf(d) * 4 * PI;
+    }
+    const double uniformTime = millisecondsSince(start);
+    start = Clock::now();
+    for (int k = 0; k < samples; ++k) {
+        sampler.startPixelSample(0, 12, k);
+        Vec d;
+        double pdf;
+        Vec radiance = environment.sample(d, pdf, sampler);
+        double value = pdf > 0 ? luminance(radiance) / pdf : 0;
+        sum[1] += value, sumSq[1] += value * value;
+    }
+    const double sampleTime = millisecondsSince(start);
+
+    printf("pdf integrates to %.4f over the sphere\n", pdfSum / samples);
+    printf("sampling     ns/sample  total luminance  relative stddev per sample\n");
+    const char* names[] = { "uniform", "importance" };
+    const double times[] = { uniformTime, sampleTime };
+    for (int e = 0; e < 2; ++e) {
+        double mean = sum[e] / samples;
+        double deviation = sqrt(std::max(0.0, sumSq[e] / samples - mean * mean));
+        printf("%-10s  %10.1f  %15.4f  %26.3f\n", names[e], times[e] * 1e6 / samples, mean, mean > 0 ? deviation / mean : 0);
+    }
+    return 0;
+}
+
+int runBenchmark(int argc, char* argv[]) {
+    const char* name = argc > 0 ? argv[0] : "";
+    if (!strcmp(name, "refit")) return benchRefit(argc - 1, argv + 1);
+    if (!strcmp(name, "build")) return benchBuild(argc - 1, argv + 1);
+    if (!strcmp(name, "wide")) return benchWide(argc - 1, argv + 1);
+    if (!strcmp(name, "leak")) return benchLeak(argc - 1, argv + 1);
+    if (!strcmp(name, "walls")) return benchWalls(argc - 1, argv + 1);
+    if (!strcmp(name, "dispatch")) return benchDispatch(argc - 1, argv + 1);
+    if (!strcmp(name, "kernels")) return benchKernels(argc - 1, argv + 1);
+    if (!strcmp(name, "furnace")) return benchFurnace(argc - 1, argv + 1);
+    if (!strcmp(name, "materials")) return benchMaterials(argc - 1, argv + 1);
+    if (!strcmp(name, "environment")) return benchEnvironment(argc - 1, argv + 1);
+    if (!strcmp(name, "fireflies")) return benchFireflies(argc - 1, argv + 1);
+    if (!strcmp(name, "roulette")) return benchRoulette(argc - 1, argv + 1);
+    if (!strcmp(name, "accumulation")) return benchAccumulation(argc - 1, argv + 1);
+    if (!strcmp(name, "scaling")) return benchScaling(argc - 1, argv + 1);
+    if (!strcmp(name, "lights")) return benchLights(argc - 1, argv + 1);
+
+    fprintf(stderr, "Unknown benchmark '%s', see benchmark.hpp\n", name);
+    return 1;
+}
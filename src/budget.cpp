@@ -0,0 +1,22 @@
+#pragma once
+#include "budget.hpp"
+
+constexpr double smoothing = 0.3;   // Weight of the newest measurement
+
+FrameBudget::FrameBudget(double targetTime, int maxSamples)
+    : targetTime(targetTime), throughput(0), lastTime(0), maxSamples(maxSamples) {}
+
+int FrameBudget::samplesFor(int pixels) const {
+    if (throughput <= 0 || pixels <= 0) return 1;
+    const double affordable = targetTime * throughput / pixels;
+    int spp = 1;
+    while (spp * 2 <= affordable && spp * 2 <= maxSamples) spp *= 2;
+    return spp;
+}
+
+void FrameBudget::record(double pixelSamples, double time) {
+    lastTime = time;
+    if (pixelSamples <= 0 || time <= 0) return;
+    const double measured = pixelSamples / time;
+    throughput = throughput > 0 ? throughput + (measured - throughput) * smoothing : measured;
+}
@@ -0,0 +1,226 @@
+#pragma once
+#include "bvh.hpp"
+#include <numeric>
+#include <thread>
+#include <atomic>
+
+constexpr int numBins = 16;
+constexpr int maxLeafSize = 4;
+constexpr double traversalCost = 1.0;     // Relative to one primitive test
+constexpr int parallelGrain = 16384;      // Nodes with fewer primitives are built by a single thread
+
+// Calls fn(begin, end) on numThreads even slices of [0, count), the first slice on the calling thread
+template <typename Fn>
+static void parallelFor(int count, int numThreads, const Fn& fn) {
+    if (numThreads <= 1) {
+        fn(0, count);
+        return;
+    }
+    std::vector<std::thread> workers;
+    const int chunk = (count + numThreads - 1) / numThreads;
+    for (int t = 1; t < numThreads; ++t) {
+        workers.emplace_back(fn, std::min(count, t * chunk), std::min(count, (t + 1) * chunk));
+    }
+    fn(0, std::min(count, chunk));
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+struct Bins {
+    AABB box[numBins];
+    int count[numBins] = {};
+};
+
+// State shared by all threads of one build. Nodes are preallocated and handed out in sibling pairs.
+struct BVHBuilder {
+    const std::vector<AABB>& bounds;
+    std::vector<Vec> centroids;
+    std::vector<int>& indices;
+    std::vector<BVHNode>& nodes;
+    std::atomic<int> nextNode;
+
+    BVHBuilder(const std::vector<AABB>& bounds, std::vector<int>& indices, std::vector<BVHNode>& nodes)
+        : bounds(bounds), centroids(bounds.size()), indices(indices), nodes(nodes), nextNode(1) {
+    }
+
+    // level is the depth of node, 1 for the root
+    void subdivide(int node, int start, int count, int level, int numThreads);
+};
+
+// Inner levels a median split subtree over count primitives needs at most
+static int medianDepth(int count) {
+    int levels = 0;
+    while ((1 << levels) < count) ++levels;
+    return levels;
+}
+
+void BVH::build(const std::vector<AABB>& bounds, int numThreads) {
+    const int n = static_cast<int>(bounds.size());
+    nodes.clear();
+    indices.resize(n);
+    std::iota(indices.begin(), indices.end(), 0);
+    if (!n) return;
+
+    if (numThreads <= 0) numThreads = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+    if (n < parallelGrain) numThreads = 1;
+
+    nodes.resize(2 * n - 1);
+    BVHBuilder builder(bounds, indices, nodes);
+    parallelFor(n, numThreads, [&](int begin, int end) {
+        for (int i = begin; i < end; ++i) {
+            builder.centroids[i] = bounds[i].centroid();
+        }
+    });
+    builder.subdivide(0, 0, n, 1, numThreads);
+    nodes.resize(builder.nextNode.load());
+}
+
+void BVHBuilder::subdivide(int node, int start, int count, int level, int numThreads) {
+    if (count < parallelGrain) numThreads = 1;
+
+    // Bounds of the primitives and of their centroids, reduced per thread for big nodes
+    std::vector<AABB> boxes(numThreads), centroidBoxes(numThreads);
+    parallelFor(count, numThreads, [&](int begin, int end) {
+        const int t = begin / ((count + numThreads - 1) / numThreads);
+        for (int i = start + begin; i < start + end; ++i) {
+            boxes[t].expand(bounds[indices[i]]);
+            centroidBoxes[t].expand(centroids[indices[i]]);
+        }
+    });
+    AABB box, centroidBox;
+    for (int t = 0; t < numThreads; ++t) {
+        box.expand(boxes[t]);
+        centroidBox.expand(centroidBoxes[t]);
+    }
+    nodes[node].box = box;
+    nodes[node].start = start;
+    nodes[node].count = count;
+    if (count <= 1) return;
+
+    // Split along the longest centroid axis
+    Vec extent = centroidBox.extent();
+    int axis = extent.x > extent.y && extent.x > extent.z ? 0 : extent.y > extent.z ? 1 : 2;
+    const double lo = axis == 0 ? centroidBox.min.x : axis == 1 ? centroidBox.min.y : centroidBox.min.z;
+    const double width = axis == 0 ? extent.x : axis == 1 ? extent.y : extent.z;
+
+    // Near the depth limit, balanced splits keep the rest of the subtree within it
+    const bool balance = level - 1 + medianDepth(count) >= BVH::maxDepth;
+    if (width <= 0 || balance) {
+        if (count <= maxLeafSize) return;
+    }
+
+    int split = start;
+    if (width > 0 && !balance) {
+        // Bin the centroids and sweep for the cheapest SAH split
+        auto binOf = [&](int prim) {
+            const Vec& c = centroids[prim];
+            double v = axis == 0 ? c.x : axis == 1 ? c.y : c.z;
+            return std::min(numBins - 1, static_cast<int>((v - lo) / width * numBins));
+        };
+        std::vector<Bins> threadBins(numThreads);
+        parallelFor(count, numThreads, [&](int begin, int end) {
+            Bins& bins = threadBins[begin / ((count + numThreads - 1) / numThreads)];
+            for (int i = start + begin; i < start + end; ++i) {
+                int b = binOf(indices[i]);
+                bins.box[b].expand(bounds[indices[i]]);
+                ++bins.count[b];
+            }
+        });
+        AABB binBox[numBins];
+        int binCount[numBins] = {};
+        for (const Bins& bins : threadBins) {
+            for (int b = 0; b < numBins; ++b) {
+                binBox[b].expand(bins.box[b]);
+                binCount[b] += bins.count[b];
+            }
+        }
+
+        double rightArea[numBins];
+        int rightCount[numBins];
+        AABB right;
+        int n = 0;
+        for (int b = numBins - 1; b > 0; --b) {
+            right.expand(binBox[b]);
+            n += binCount[b];
+            rightArea[b] = right.surfaceArea();
+            rightCount[b] = n;
+        }
+
+        double bestCost = 1e300;
+        int bestBin = -1;
+        AABB left;
+        n = 0;
+        for (int b = 1; b < numBins; ++b) {
+            left.expand(binBox[b - 1]);
+            n += binCount[b - 1];
+            if (!n || !rightCount[b]) continue;
+            double c = left.surfaceArea() * n + rightArea[b] * rightCount[b];
+            if (c < bestCost) {
+                bestCost = c;
+                bestBin = b;
+            }
+        }
+
+        // Stay a leaf when no split beats testing every primitive
+        const double leafCost = box.surfaceArea() * count;
+        if (count <= maxLeafSize && (bestBin < 0 || traversalCost * box.surfaceArea() + bestCost >= leafCost)) return;
+
+        if (bestBin > 0) {
+            split = static_cast<int>(std::partition(indices.begin() + start, indices.begin() + start + count,
+                [&](int prim) { return binOf(prim) < bestBin; }) - indices.begin());
+        }
+    }
+
+    // Fall back to a median split when binning could not separate the primitives
+    if (split == start || split == start + count) {
+        split = start + count / 2;
+        std::nth_element(indices.begin() + start, indices.begin() + split, indices.begin() + start + count, [&](int a, int b) {
+            const Vec &ca = centroids[a], &cb = centroids[b];
+            return axis == 0 ? ca.x < cb.x : axis == 1 ? ca.y < cb.y : ca.z < cb.z;
+        });
+    }
+
+    const int child = nextNode.fetch_add(2);
+    nodes[node].start = child;
+    nodes[node].count = 0;
+    const int leftCount = split - start, rightCount = start + count - split;
+    if (numThreads == 1) {
+        subdivide(child, start, leftCount, level + 1, 1);
+        subdivide(child + 1, split, rightCount, level + 1, 1);
+        return;
+    }
+
+    // Share the threads between the subtrees by size and build the left one on its own thread
+    const int leftThreads = std::max(1, std::min(numThreads - 1, static_cast<int>(static_cast<double>(numThreads) * leftCount / count + 0.5)));
+    std::thread leftBuild(&BVHBuilder::subdivide, this, child, start, leftCount, level + 1, leftThreads);
+    subdivide(child + 1, split, rightCount, level + 1, numThreads - leftThreads);
+    leftBuild.join();
+}
+
+void BVH::refit(const std::vector<AABB>& bounds) {
+    for (int i = static_cast<int>(nodes.size()) - 1; i >= 0; --i) {
+        BVHNode& node = nodes[i];
+        node.box = AABB();
+        if (node.count) {
+            for (int j = node.start; j < node.start + node.count; ++j) {
+                node.box.expand(bounds[indices[j]]);
+            }
+        }
+        else {
+            node.box.expand(nodes[node.start].box);
+            node.box.expand(nodes[node.start + 1].box);
+        }
+    }
+}
+
+double BVH::cost() const {
+    if (nodes.empty()) return 0;
+    const double rootArea = nodes[0].box.surfaceArea();
+    if (rootArea <= 0) return 0;
+    double c = 0;
+    for (const auto& node : nodes) {
+        c += node.box.surfaceArea() / rootArea * (node.count ? node.count : traversalCost);
+    }
+    return c;
+}
@@ -1,5 +1,6 @@
 #pragma once
 #include "denoiser.hpp"
+#include "profiler.hpp"
 
 void checkError(oidn::DeviceRef& device) {
     const char* errorMessage;
@@ -9,7 +10,7 @@ void checkError(oidn::DeviceRef& device) {
     }
 }
 
-OIDNDenoiser::OIDNDenoiser(int w, int h) : width(w), height(h), device(oidn::newDevice(oidn::DeviceType::CPU)) {
+OIDNDenoiser::OIDNDenoiser(int w, int h) : width(w), height(h), depthData(w * h), device(oidn::newDevice(oidn::DeviceType::CPU)) {
     device.commit();
 	colorBuffer = device.newBuffer(width * height * 3 * sizeof(float));
 	albedoBuffer = device.newBuffer(width * height * 3 * sizeof(float));
@@ -19,33 +20,57 @@ OIDNDenoiser::OIDNDenoiser(int w, int h) : width(w), height(h), device(oidn::new
 	albedoData = static_cast<float*>(albedoBuffer.getData());
 	normalData = static_cast<float*>(normalBuffer.getData());
 
+    filter = device.newFilter("RT");
+    filter.setImage("color", colorBuffer, oidn::Format::Float3, width, height);
+    filter.setImage("normal", normalBuffer, oidn::Format::Float3, width, height);
+    filter.setImage("albedo", albedoBuffer, oidn::Format::Float3, width, height);
+    filter.setImage("output", colorBuffer, oidn::Format::Float3, width, height);
+    filter.set("hdr", true);    // Samples aren't clamped, bright pixels go well past one
+    filter.commit();
+
     checkError(device);
 }
 
-void OIDNDenoiser::computeAuxiliary(const Shape* shapes[], const Camera& cam) {
-    for (int y = 0; y < height; ++y) {
+void OIDNDenoiser::computeAuxiliary(const Scene& scene, const Camera& cam, WorkerPool& workers) {
+    const int rowsPerWorker = (height + workers.size() - 1) / workers.size();
+    auto job = [&](int worker) {
+        computeAuxiliaryRows(scene, cam, std::min(height, worker * rowsPerWorker), std::min(height, (worker + 1) * rowsPerWorker));
+    };
+    workers.run(job);
+    workers.wait();
+}
+
+void OIDNDenoiser::computeAuxiliaryRows(const Scene& scene, const Camera& cam, int startY, int endY) {
+    PROFILE_SCOPE("auxiliary rows");
+    for (int y = startY; y < endY; ++y) {
         for (int x = 0; x < width; ++x) {
             const int i = (height - y - 1) * width + x;
             Vec d = cam.u * ((x + .5) / width - .5) + cam.v * ((y + .5) / height - .5) + cam.w;
             Ray ray(cam.pos, d.normalize());
 
+            for (int k = 0; k < 3; ++k) {
+                normalData[i * 3 + k] = albedoData[i * 3 + k] = 0;
+            }
+            depthData[i] = 0;
+
             int id;
             double t;
             Vec p, n;
-            if (intersect(ray, t, id, &p, &n)) {
+            if (scene.intersect(ray, t, id, &p, &n)) {
+                depthData[i] = static_cast<float>(t);
                 normalData[i * 3 + 0] = static_cast<float>(n.x);
                 normalData[i * 3 + 1] = static_cast<float>(n.y);
                 normalData[i * 3 + 2] = static_cast<float>(n.z);
 
-                while (shapes[id]->brdf.isSpecular()) {
-                    ray = Ray(p, dynamic_cast<const SpecularBRDF*>(&shapes[id]->brdf)->mirroredDirection(n, ray.d * -1));
-                    if (!intersect(ray, t, id, &p, &n)) break;
+                while (scene.shapes[id]->brdf.type == BRDFType::Specular) {
+                    ray = Ray(p, SpecularBRDF::mirroredDirection(n, ray.d * -1));
+                    if (!scene.intersect(ray, t, id, &p, &n)) break;
                 }
-                if (!shapes[id]->brdf.isSpecular()) {
-                    Vec kd = dynamic_cast<const DiffuseBRDF*>(&shapes[id]->brdf)->kd;
-                    albedoData[i * 3 + 0] = static_cast<float>(kd.x);
-                    albedoData[i * 3 + 1] = static_cast<float>(kd.y);
-                    albedoData[i * 3 + 2] = static_cast<float>(kd.z);
+                if (scene.shapes[id]->brdf.type != BRDFType::Specular) {
+                    Vec albedo = scene.shapes[id]->brdf.albedo();
+                    albedoData[i * 3 + 0] = static_cast<float>(albedo.x);
+                    albedoData[i * 3 + 1] = static_cast<float>(albedo.y);
+                    albedoData[i * 3 + 2] = static_cast<float>(albedo.z);
                 }
             }
         }
@@ -53,12 +78,6 @@ void OIDNDenoiser::computeAuxiliary(const Shape* shapes[], const Camera& cam) {
 }
 
 void OIDNDenoiser::execute() {
-    oidn::FilterRef filter = device.newFilter("RT");
-    filter.setImage("color", colorBuffer, oidn::Format::Float3, width, height);
-    filter.setImage("normal", normalBuffer, oidn::Format::Float3, width, height);
-    filter.setImage("albedo", albedoBuffer, oidn::Format::Float3, width, height);
-    filter.setImage("output", colorBuffer, oidn::Format::Float3, width, height);
-    filter.commit();
     filter.execute();
 
     const char* errorMessage;
@@ -0,0 +1,197 @@
+#pragma once
+#include "environment.hpp"
+#include "util.hpp"
+#include "pfm.hpp"
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+
+static double luminance(const float* rgb) {
+    return 0.2126 * rgb[0] + 0.7152 * rgb[1] + 0.0722 * rgb[2];
+}
+
+/*
+ * Vose's alias method over n weights. A bin is kept with probability
+ * threshold and otherwise gives way to its alias, so every bin ends up with
+ * its share of the total. All-zero weights give a uniform table.
+ */
+static void buildAlias(const double* weights, int n, float* threshold, int* alias) {
+    double total = 0;
+    for (int i = 0; i < n; ++i) total += weights[i];
+    std::vector<double> scaled(n);
+    std::vector<int> small, large;
+    for (int i = 0; i < n; ++i) {
+        scaled[i] = total > 0 ? weights[i] * n / total : 1;
+        (scaled[i] < 1 ? small : large).push_back(i);
+    }
+    while (!small.empty() && !large.empty()) {
+        int s = small.back(), l = large.back();
+        small.pop_back();
+        threshold[s] = static_cast<float>(scaled[s]);
+        alias[s] = l;
+        scaled[l] -= 1 - scaled[s];
+        if (scaled[l] < 1) {
+            large.pop_back();
+            small.push_back(l);
+        }
+    }
+    // What remains is one up to rounding
+    for (int i : small) threshold[i] = 1, alias[i] = i;
+    for (int i : large) threshold[i] = 1, alias[i] = i;
+}
+
+static int sampleAlias(const float* threshold, const int* alias, int n, double u) {
+    double scaled = u * n;
+    int i = std::min(n - 1, static_cast<int>(scaled));
+    return scaled - i < threshold[i] ? i : alias[i];
+}
+
+bool Environment::load(const std::string& path, double scale) {
+    clear();
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        std::cerr << "Error opening file: " << path << "\n";
+        return false;
+    }
+    bool ok = path.size() >= 4 && path.compare(path.size() - 4, 4, ".pfm") == 0 ? readPFM(file, width, height, texels) : readHDR(file);
+    if (!ok) {
+        std::cerr << path << ": not a PFM or Radiance HDR image\n";
+        clear();
+        return false;
+    }
+    for (float& texel : texels) {
+        texel = std::max(0.0f, texel * static_cast<float>(scale));
+    }
+    buildDistribution();
+    return true;
+}
+
+void Environment::clear() {
+    width = height = 0;
+    texels.clear();
+    probability.clear();
+    threshold.clear();
+    alias.clear();
+}
+
+// Shared-exponent RGBE scanlines, flat or run-length encoded per channel, top row first
+bool Environment::readHDR(std::istream& in) {
+    std::string line;
+    if (!std::getline(in, line) || line.compare(0, 2, "#?") != 0) return false;
+    while (std::getline(in, line) && !line.empty()) {
+        if (line.compare(0, 7, "FORMAT=") == 0 && line != "FORMAT=32-bit_rle_rgbe") return false;
+    }
+    std::string yAxis, xAxis;
+    if (!std::getline(in, line)) return false;
+    std::istringstream resolution(line);
+    if (!(resolution >> yAxis >> height >> xAxis >> width) || yAxis != "-Y" || xAxis != "+X" || width <= 0 || height <= 0) return false;
+
+    texels.resize(static_cast<size_t>(width) * height * 3);
+    std::vector<unsigned char> scanline(static_cast<size_t>(width) * 4);
+    for (int y = 0; y < height; ++y) {
+        unsigned char head[4];
+        if (!in.read(reinterpret_cast<char*>(head), 4)) return false;
+        if (width >= 8 && width < 32768 && head[0] == 2 && head[1] == 2 && !(head[2] & 0x80)) {
+            if ((head[2] << 8 | head[3]) != width) return false;
+            for (int c = 0; c < 4; ++c) {
+                for (int x = 0; x < width;) {
+                    int count = in.get();
+                    if (count == EOF) return false;
+                    if (count > 128) {
+                        count -= 128;
+                        int value = in.get();
+                        if (value == EOF || x + count > width) return false;
+                        for (; count > 0; --count) scanline[(x++) * 4 + c] = static_cast<unsigned char>(value);
+                    }
+                    else {
+                        if (count == 0 || x + count > width) return false;
+                        for (; count > 0; --count) {
+                            int value = in.get();
+                            if (value == EOF) return false;
+                            scanline[(x++) * 4 + c] = static_cast<unsigned char>(value);
+                        }
+                    }
+                }
+            }
+        }
+        else {
+            memcpy(scanline.data(), head, 4);
+            if (!in.read(reinterpret_cast<char*>(scanline.data() + 4), scanline.size() - 4)) return false;
+        }
+        float* out = &texels[static_cast<size_t>(y) * width * 3];
+        for (int x = 0; x < width; ++x) {
+            const unsigned char* rgbe = &scanline[x * 4];
+            float f = rgbe[3] ? static_cast<float>(ldexp(1.0, rgbe[3] - 136)) : 0.0f;
+            for (int c = 0; c < 3; ++c) out[x * 3 + c] = rgbe[c] * f;
+        }
+    }
+    return true;
+}
+
+// Texels weighted by luminance and by the solid angle they cover, which shrinks towards the poles
+void Environment::buildDistribution() {
+    const size_t numTexels = static_cast<size_t>(width) * height;
+    probability.resize(numTexels);
+    threshold.resize(numTexels + height);
+    alias.resize(numTexels + height);
+
+    std::vector<double> weights(width), rowWeights(height);
+    double total = 0;
+    for (int y = 0; y < height; ++y) {
+        const double sinTheta = sin(PI * (y + 0.5) / height);
+        double rowTotal = 0;
+        for (int x = 0; x < width; ++x) {
+            weights[x] = luminance(&texels[(static_cast<size_t>(y) * width + x) * 3]) * sinTheta;
+            rowTotal += weights[x];
+            probability[static_cast<size_t>(y) * width + x] = static_cast<float>(weights[x]);
+        }
+        buildAlias(weights.data(), width, &threshold[static_cast<size_t>(y) * width], &alias[static_cast<size_t>(y) * width]);
+        rowWeights[y] = rowTotal;
+        total += rowTotal;
+    }
+    buildAlias(rowWeights.data(), height, &threshold[numTexels], &alias[numTexels]);
+
+    // A black map is sampled uniformly, like its alias tables
+    for (size_t i = 0; i < numTexels; ++i) {
+        probability[i] = total > 0 ? static_cast<float>(probability[i] / total) : 1.0f / numTexels;
+    }
+}
+
+int Environment::texelOf(const Vec& d) const {
+    const double u = atan2(d.x, -d.z) / (2 * PI) + 0.5;
+    const double v = acos(std::max(-1.0, std::min(1.0, d.y))) / PI;
+    const int x = std::max(0, std::min(width - 1, static_cast<int>(u * width)));
+    const int y = std::max(0, std::min(height - 1, static_cast<int>(v * height)));
+    return y * width + x;
+}
+
+Vec Environment::radiance(const Vec& d) const {
+    const float* texel = &texels[static_cast<size_t>(texelOf(d)) * 3];
+    return Vec(texel[0], texel[1], texel[2]);
+}
+
+Vec Environment::sample(Vec& d, double& pdf, Sampler& sampler) const {
+    double u1, u2, j1, j2;
+    sampler.get2D(u1, u2);
+    sampler.get2D(j1, j2);
+    const size_t numTexels = static_cast<size_t>(width) * height;
+    const int y = sampleAlias(&threshold[numTexels], &alias[numTexels], height, u1);
+    const int x = sampleAlias(&threshold[static_cast<size_t>(y) * width], &alias[static_cast<size_t>(y) * width], width, u2);
+
+    // Uniform within the texel
+    const double theta = PI * (y + j1) / height, phi = 2 * PI * ((x + j2) / width - 0.5);
+    const double sinTheta = sin(theta);
+    d = Vec(sinTheta * sin(phi), cos(theta), -sinTheta * cos(phi));
+    const size_t texel = static_cast<size_t>(y) * width + x;
+    pdf = sinTheta > 0 ? probability[texel] * numTexels / (2 * PI * PI * sinTheta) : 0;
+    return Vec(texels[texel * 3], texels[texel * 3 + 1], texels[texel * 3 + 2]);
+}
+
+double Environment::pdf(const Vec& d) const {
+    const double sinTheta = sqrt(std::max(0.0, 1 - d.y * d.y));
+    if (sinTheta <= 0) return 0;
+    return probability[texelOf(d)] * static_cast<double>(width) * height / (2 * PI * PI * sinTheta);
+}
@@ -9,6 +9,15 @@ boolean inFocus = true;
 std::atomic<bool> input_flags[6];   // Flags indicating a key was held down during a frame.
 std::atomic<int> dx, dy;
 std::atomic<bool> newInput;
+std::atomic<long long> inputTime;
+std::atomic<bool> saveRequested;
+boolean saveKeyState = false;
+
+void raiseInput() {
+    if (!newInput.exchange(true)) {
+        inputTime.store(std::chrono::steady_clock::now().time_since_epoch().count());
+    }
+}
 
 void centerMouse(HWND hwnd) {
     RECT rect;
@@ -40,12 +49,23 @@ void handleInput(HWND hwnd) {
         }
         if (!inFocus) continue;
 
+        // Save the accumulated radiance once per press of P, without disturbing the render
+        if ((GetAsyncKeyState('P') & 0x8000) != 0) {
+            if (!saveKeyState) {
+                saveKeyState = true;
+                saveRequested.store(true);
+            }
+        }
+        else {
+            saveKeyState = false;
+        }
+
         handleMouseInput(hwnd);
         // Raise flags for each of the keys that were held down during a frame.
         for (int i = 0; i < 6; ++i) {
             if (GetAsyncKeyState(keys[i]) & 0x8000) {
                 input_flags[i].store(true);
-                newInput.store(true);
+                raiseInput();
             }
         }
     }
@@ -63,7 +83,7 @@ void handleMouseInput(HWND hwnd) {
     lastMousePos.store(currentMousePos);
 
     if (inFocus && (dx.load() != 0 || dy.load() != 0)) {
-        newInput.store(true);
+        raiseInput();
     }
 }
 
@@ -0,0 +1,54 @@
+#pragma once
+#include "instance.hpp"
+
+Instance::Instance(const STLModel& model, const Transform& toWorld, Vec e, const BRDF& brdf)
+    : Shape(brdf, e), model(model), toWorld(toWorld), toObject(toWorld.inverse()),
+      boundingSphere(model.radius * toWorld.maxScale(), toWorld.point(Vec()), e, brdf) {}
+
+void Instance::setTransform(const Transform& t) {
+    toWorld = t;
+    toObject = t.inverse();
+    boundingSphere.p = t.point(Vec());
+    boundingSphere.rad = model.radius * t.maxScale();
+}
+
+double Instance::intersect(const Ray& ray, Vec* point, Vec* normal) const {
+    if (!boundingSphere.intersect(ray, 0, 0)) return 0;
+
+    // The object space direction is left unnormalized so hit distances carry over
+    Ray local(toObject.point(ray.o), toObject.vector(ray.d));
+    Vec n;
+    double t = model.intersect(local, &n);
+    if (t && point && normal) {
+        *point = ray.o + ray.d * t;
+        *normal = toObject.transposed(n).normalize();
+    }
+    return t;
+}
+
+void Instance::sample(Vec& point, Vec& normal, double& pdf, Sampler& sampler) const {
+    if (model.triangles.empty()) {
+        return;
+    }
+
+    double triPdf;
+    const Triangle& tri = model.sampleTriangle(sampler.get1D(), triPdf);
+    tri.sample(point, normal, pdf, sampler);
+    point = toWorld.point(point);
+    normal = toObject.transposed(normal).normalize();
+
+    // Uniform within the triangle's world space area
+    double worldArea = 0.5 * (toWorld.vector(tri.v1 - tri.v0).cross(toWorld.vector(tri.v2 - tri.v0))).length();
+    pdf = triPdf / worldArea;
+}
+
+
+AABB Instance::bounds() const {
+    AABB box;
+    for (int i = 0; i < 8; ++i) {
+        box.expand(toWorld.point(Vec(i & 1 ? model.box.max.x : model.box.min.x,
+                                     i & 2 ? model.box.max.y : model.box.min.y,
+                                     i & 4 ? model.box.max.z : model.box.min.z)));
+    }
+    return box;
+}
\ No newline at end of file
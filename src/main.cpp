@@ -3,6 +3,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <vector>
 #include <chrono>
 #include <thread>
@@ -17,59 +18,200 @@
 #include "scene.hpp"
 #include "denoiser.hpp"
 #include "pathtracer.hpp"
+#include "temporal.hpp"
+#include "accumulator.hpp"
+#include "offline.hpp"
+#include "budget.hpp"
+#include "benchmark.hpp"
+#include "workerpool.hpp"
+#include "alloccount.hpp"
+#include "profiler.hpp"
 
 constexpr int width = 480, height = 360;
 constexpr int FPS = 60;
 constexpr std::chrono::milliseconds frameDuration(1000 / FPS);
-std::atomic<int> samps(1);
+constexpr double motionFrameTarget = 1000.0 / 30;  // Trace time in ms a frame may take while the camera moves
+constexpr int maxRenderScale = 4;
+constexpr double frameTarget = 16;   // Trace time in ms the budget controller aims for at rest
 
-int main() {
-    rng.init(std::thread::hardware_concurrency());
-    auto previous = std::chrono::high_resolution_clock::now();
+int main(int argc, char* argv[]) {
+    // Headless benchmarks
+    if (argc > 1 && !strcmp(argv[1], "--bench")) {
+        return runBenchmark(argc - 2, argv + 2);
+    }
+
+    // Offline renders to checkpoints, merging them and comparing images
+    if (argc > 1 && !strcmp(argv[1], "--render")) {
+        return renderOffline(argc - 2, argv + 2);
+    }
+    if (argc > 1 && !strcmp(argv[1], "--merge")) {
+        return mergeCheckpoints(argc - 2, argv + 2);
+    }
+    if (argc > 1 && !strcmp(argv[1], "--compare")) {
+        return compareImages(argc - 2, argv + 2);
+    }
+
+    // Scene given on the command line, the Cornell box by default, the render settings (see
+    // parseRenderSetting), the worker placement (see parseThreadPlacement) and:
+    //   --hdr <path>              file P saves the accumulated HDR radiance of the current view to
+    //   --trace <path>            Chrome trace of the first frames, in builds with ENABLE_PROFILING
+    //   --trace-frames <n>        frames the trace covers (300)
+    const char* scenePath = "rsrc/scenes/cornell.scene";
+    const char* hdrPath = "render.acc";
+    const char* tracePath = nullptr;
+    int traceFrames = 300;
+    RenderSettings settings;
+    ThreadPlacement placement;
+    for (int i = 1; i < argc; ++i) {
+        if (i + 1 < argc && parseRenderSetting(argv[i], argv[i + 1], settings)) ++i;
+        else if (i + 1 < argc && parseThreadPlacement(argv[i], argv[i + 1], placement)) ++i;
+        else if (!strcmp(argv[i], "--hdr") && i + 1 < argc) hdrPath = argv[++i];
+        else if (!strcmp(argv[i], "--trace") && i + 1 < argc) tracePath = argv[++i];
+        else if (!strcmp(argv[i], "--trace-frames") && i + 1 < argc) traceFrames = std::max(1, atoi(argv[++i]));
+        else scenePath = argv[i];
+    }
+    Scene scene;
+    if (!scene.load(scenePath)) {
+        return 1;
+    }
 
-    // Wrapper classes essential for rendering
-    Camera cam(0, 5, 15);
+    // Wrapper classes essential for rendering, and the threads every frame runs on
+    WorkerPool workers(placement);
+    Camera cam(scene.cameraPos.x, scene.cameraPos.y, scene.cameraPos.z);
     Window window(height, width);
     OIDNDenoiser denoiser(width, height);
-    PathTracer pathTracer(denoiser.colorData, width, height, cam, window);
+    PathTracer pathTracer(scene, denoiser.colorData, width, height, cam, window, workers);
+    pathTracer.settings = settings;
+    pathTracer.guideDepth = denoiser.depthData.data();
+    pathTracer.guideNormal = denoiser.normalData;
+    TemporalReprojector temporal(width, height);
+    Accumulator accumulator(width, height);     // Unclamped radiance of the view since the camera last moved
+    bool cameraMoved = true;
+    int motionScale = 1;    // Resolution divisor used while the camera moves, native at rest
+    FrameBudget budget(frameTarget);
+    int spp = 1;
+
+    // Time from an input event to the first frame presented from the new view
+    long long pendingInput = 0;
+    double maxLatency = 0;
 
     // Separate thread for handling mouse and keyboard inputs
     std::thread inputThread(handleInput, window.hwnd);
 
+    // Trace buffers are reserved here, recording them allocates nothing
+    profileThreadName("main");
+    int tracedFrames = tracePath && startProfiling(workers.size(), traceFrames) ? 0 : -1;
+
     while (1) { 
+        // Writing the file allocates, so it happens before the frame's checks
+        if (saveRequested.exchange(false) && accumulator.save(hdrPath)) {
+            printf("Saved the accumulated radiance to %s\n", hdrPath);
+        }
+        if (tracedFrames == traceFrames) {
+            stopProfiling();
+            if (writeProfile(tracePath)) printf("Wrote a trace of %d frames to %s\n", traceFrames, tracePath);
+            tracedFrames = -1;
+        }
+
+        // Everything a frame needs was allocated above, checked in debug builds
+        NoAllocationScope noAllocations;
+        PROFILE_SCOPE("frame");
         auto start = std::chrono::high_resolution_clock::now();
-        auto elapsedTime = std::chrono::duration_cast<std::chrono::milliseconds>(start - previous);  
 
-        // Path trace for samps samples
-        pathTracer.pathTrace(samps);
+        // Generate auxiliary buffers and carry the accumulated history over to the new view
+        if (cameraMoved) {
+            PROFILE_SCOPE("computeAuxiliary");
+            denoiser.computeAuxiliary(scene, cam, workers);
+            temporal.reproject(cam, denoiser.depthData.data());
+            accumulator.clear();
+        }
 
-        // Skip rendering and reset samples
-        if (newInput.load() && inFocus && samps > 1) {
-            samps = 1;
+        // Path trace for spp samples, direct lighting only until there is history to blend with
+        const int scale = cameraMoved ? motionScale : 1;
+        const int pixels = (width / scale) * (height / scale);
+        auto traceStart = std::chrono::high_resolution_clock::now();
+        const bool preview = !temporal.hasHistory();
+        bool complete;
+        {
+            PROFILE_SCOPE("pathTrace");
+            complete = pathTracer.pathTrace(spp, preview, scale);
         }
-        else {
-            // Generate auxiliary buffers on second frame
-            if (samps == 2) {
-                denoiser.computeAuxiliary(shapes, cam);
+        std::chrono::duration<double, std::milli> traceTime = std::chrono::high_resolution_clock::now() - traceStart;
+        budget.record(static_cast<double>(pixels) * spp * pathTracer.tilesDone / pathTracer.numTiles, traceTime.count());
+
+        // Pick the motion resolution from the trace time, a halving quarters the pixels traced
+        if (cameraMoved) {
+            if (traceTime.count() > motionFrameTarget && motionScale < maxRenderScale) {
+                motionScale *= 2;
             }
-            // Denoise on second frame and beyond
-            if (samps > 1) {
-                denoiser.execute();
+            else if (traceTime.count() * 4 < motionFrameTarget * 0.8 && motionScale > 1) {
+                motionScale /= 2;
             }
+        }
+
+        // Full resolution frames of the whole path space add to the HDR sums, before the history blend overwrites them
+        {
+            PROFILE_SCOPE("accumulate");
+            if (scale == 1 && !preview) {
+                accumulator.add(denoiser.colorData, pathTracer.pixelSamples.data(), static_cast<float>(1 / exposure));
+            }
+
+            // Keep the finished tiles of a cancelled frame, the rest shows the history
+            temporal.accumulate(denoiser.colorData, pathTracer.pixelSamples.data());
+        }
+
+        // Denoise complete frames once the camera has come to rest
+        if (complete && !cameraMoved) {
+            PROFILE_SCOPE("execute");
+            denoiser.execute();
+        }
 
-            printf("Rendered with %d samples per pixel\n", samps.load() == 1 ? 1 : (samps.load() / 2) * 4);
+        if (complete) {
+            printf("Rendered with %d samples per pixel at 1/%d resolution in %.1f ms (budget %.0f ms, %.2f Msamples/s)\n",
+                spp, scale, budget.lastTime, budget.targetTime, budget.throughput / 1000);
+        }
+        else {
+            printf("Cancelled after %d/%d tiles with %d samples per pixel (longest tile %.1f ms)\n",
+                pathTracer.tilesDone, pathTracer.numTiles, spp, pathTracer.maxTileTime);
+        }
+        {
+            PROFILE_SCOPE("writeBits");
             denoiser.writeBits(window.bits);
+        }
+        {
+            PROFILE_SCOPE("refresh");
             window.refresh();
+        }
+        if (tracedFrames >= 0) {
+            profileFrame();
+            ++tracedFrames;
+        }
 
-            samps = min(128, samps * 2);
+        // This frame was traced from the view the pending input moved to
+        if (pendingInput) {
+            std::chrono::duration<double, std::milli> latency = std::chrono::steady_clock::now().time_since_epoch()
+                - std::chrono::steady_clock::duration(pendingInput);
+            maxLatency = std::max(maxLatency, latency.count());
+            printf("Input to frame latency %.1f ms (max %.1f ms)\n", latency.count(), maxLatency);
+            pendingInput = 0;
         }
 
+        // Spend the next frame's budget at full resolution
+        spp = complete ? budget.samplesFor(width * height) : 1;
+
         // Update camera based on user input and reset mouse position
+        Vec prevPos = cam.pos, prevDir = cam.w;
+        long long inputStart = inputTime.load();
         updateCamera(cam);
         centerMouse(window.hwnd);
+        cameraMoved = !(cam.pos == prevPos && cam.w == prevDir);
+        if (cameraMoved) {
+            spp = 1;
+            pendingInput = inputStart;
+        }
 
-        previous = start;
-        std::this_thread::sleep_for(max(std::chrono::milliseconds(0), frameDuration - elapsedTime));
+        auto elapsedTime = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - start);
+        std::this_thread::sleep_for(std::max(std::chrono::milliseconds(0), frameDuration - elapsedTime));
     }
 
     return 0;
@@ -0,0 +1,291 @@
+#pragma once
+#include "offline.hpp"
+#include "pathtracer.hpp"
+#include "accumulator.hpp"
+#include "pfm.hpp"
+#include "profiler.hpp"
+#include <windows.h>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+#include <utility>
+
+constexpr int passSamples = 16;     // Samples per pixel traced between checks of the checkpoint timer
+
+// First line of a checkpoint, text lines with the render state and the accumulator follow
+static const char* const magic = "CHECKPOINT 1";
+
+struct Checkpoint {
+    std::string scene;
+    RenderSettings settings;
+    SamplerType samplerType = SamplerType::Sobol;
+    uint32_t seed = 0;
+    uint32_t nextSample = 0;    // Samples taken in every pixel, the index the next pass starts from
+    Accumulator accumulator = Accumulator(0, 0);
+};
+
+// Written beside the checkpoint and moved over it in one step, so a crash while saving keeps the last one
+static bool saveCheckpoint(const Checkpoint& checkpoint, const std::string& path) {
+    const std::string temporary = path + ".tmp";
+    {
+        std::ofstream file(temporary, std::ios::binary);
+        if (!file) {
+            std::cerr << "Error opening file: " << temporary << "\n";
+            return false;
+        }
+        const RenderSettings& s = checkpoint.settings;
+        file.precision(17);
+        file << magic << "\n";
+        file << "scene " << checkpoint.scene << "\n";
+        file << "size " << checkpoint.accumulator.width << " " << checkpoint.accumulator.height << "\n";
+        file << "sampler " << static_cast<int>(checkpoint.samplerType) << " " << checkpoint.seed << " " << checkpoint.nextSample << "\n";
+        file << "settings " << s.maxBounceRadiance << " " << s.regularization << " " << s.maxDepth << " " << s.rouletteDepth << " " << s.rouletteSurvival << "\n";
+        if (!checkpoint.accumulator.write(file)) {
+            std::cerr << "Error writing file: " << temporary << "\n";
+            return false;
+        }
+    }
+    if (!MoveFileExA(temporary.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) {
+        std::cerr << "Error moving " << temporary << " to " << path << ", error " << GetLastError() << "\n";
+        return false;
+    }
+    return true;
+}
+
+static bool sameSettings(const RenderSettings& a, const RenderSettings& b) {
+    return a.maxBounceRadiance == b.maxBounceRadiance && a.regularization == b.regularization && a.maxDepth == b.maxDepth &&
+        a.rouletteDepth == b.rouletteDepth && a.rouletteSurvival == b.rouletteSurvival;
+}
+
+static bool loadCheckpoint(Checkpoint& checkpoint, const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        std::cerr << "Error opening file: " << path << "\n";
+        return false;
+    }
+    std::string line, key;
+    int width = 0, height = 0, samplerType = -1;
+    RenderSettings& s = checkpoint.settings;
+    bool ok = std::getline(file, line) && line == magic;
+    for (int i = 0; ok && i < 4; ++i) {
+        ok = static_cast<bool>(std::getline(file, line));
+        std::istringstream fields(line);
+        fields >> key;
+        if (key == "scene") ok = static_cast<bool>(std::getline(fields >> std::ws, checkpoint.scene));
+        else if (key == "size") ok = static_cast<bool>(fields >> width >> height);
+        else if (key == "sampler") ok = static_cast<bool>(fields >> samplerType >> checkpoint.seed >> checkpoint.nextSample);
+        else if (key == "settings") ok = static_cast<bool>(fields >> s.maxBounceRadiance >> s.regularization >> s.maxDepth >> s.rouletteDepth >> s.rouletteSurvival);
+        else ok = false;
+    }
+    if (!ok || width <= 0 || height <= 0 || samplerType < 0 || samplerType > static_cast<int>(SamplerType::Sobol)) {
+        std::cerr << path << ": not a checkpoint\n";
+        return false;
+    }
+    checkpoint.samplerType = static_cast<SamplerType>(samplerType);
+    checkpoint.accumulator = Accumulator(width, height);
+    return checkpoint.accumulator.read(file, path);
+}
+
+int renderOffline(int argc, char* argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: --render <scene> <checkpoint> [--spp n] [--seed s] [--every seconds] [--size w h] [--trace path] [render settings] [thread placement]\n");
+        return 1;
+    }
+    const std::string scenePath = argv[0], path = argv[1];
+    int spp = 1024, width = 480, height = 360;
+    ThreadPlacement placement;
+    double interval = 60;
+    const char* tracePath = nullptr;
+    Checkpoint checkpoint;
+    for (int i = 2; i < argc; ++i) {
+        if (i + 1 < argc && parseRenderSetting(argv[i], argv[i + 1], checkpoint.settings)) ++i;
+        else if (i + 1 < argc && parseThreadPlacement(argv[i], argv[i + 1], placement)) ++i;
+        else if (!strcmp(argv[i], "--spp") && i + 1 < argc) spp = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--seed") && i + 1 < argc) checkpoint.seed = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+        else if (!strcmp(argv[i], "--every") && i + 1 < argc) interval = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--size") && i + 2 < argc) width = atoi(argv[++i]), height = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--trace") && i + 1 < argc) tracePath = argv[++i];
+        else {
+            fprintf(stderr, "Unknown option '%s', see offline.hpp\n", argv[i]);
+            return 1;
+        }
+    }
+
+    // Carry on from an existing checkpoint
+    if (std::ifstream(path).good()) {
+        if (!loadCheckpoint(checkpoint, path)) return 1;
+        if (checkpoint.scene != scenePath) {
+            fprintf(stderr, "Warning: %s was rendered from %s\n", path.c_str(), checkpoint.scene.c_str());
+        }
+        printf("Resuming %s at %u samples per pixel, seed %u\n", path.c_str(), checkpoint.nextSample, checkpoint.seed);
+    }
+    else {
+        if (width <= 0 || height <= 0) {
+            fprintf(stderr, "Bad size %dx%d\n", width, height);
+            return 1;
+        }
+        checkpoint.scene = scenePath;
+        checkpoint.accumulator = Accumulator(width, height);
+    }
+    width = checkpoint.accumulator.width;
+    height = checkpoint.accumulator.height;
+
+    Scene scene;
+    if (!scene.load(scenePath)) return 1;
+    Camera camera(scene.cameraPos.x, scene.cameraPos.y, scene.cameraPos.z);
+    const TileKernel kernel = tileKernel(kernelFeatures(scene, false, true));
+    WorkerPool workers(placement);
+
+    // Kernels trace 2x2 sub-pixels, so passes are whole multiples of four samples
+    const uint32_t target = static_cast<uint32_t>((std::max(spp, 1) + 3) / 4 * 4);
+    const int tilesX = (width + maxTileSize - 1) / maxTileSize;
+    const int numTiles = tilesX * ((height + maxTileSize - 1) / maxTileSize);
+    std::vector<float> frame(width * height * 3), samples(width * height);
+    std::atomic<int> nextTile;
+    int pass = 0;
+
+    // Every worker traces into a tile buffer of its own, on its node, and commits finished tiles to the frame
+    std::vector<NodeBuffer> tileBuffers;
+    tileBuffers.reserve(workers.size());
+    for (int worker = 0; worker < workers.size(); ++worker) {
+        tileBuffers.emplace_back(maxTileSize * maxTileSize * 3 * sizeof(float), workers.node(worker));
+    }
+    auto job = [&](int worker) {
+        Sampler sampler(checkpoint.samplerType, checkpoint.seed);
+        float* buffer = tileBuffers[worker].as<float>();
+        for (int tile = nextTile++; tile < numTiles; tile = nextTile++) {
+            const int startX = (tile % tilesX) * maxTileSize, startY = (tile / tilesX) * maxTileSize;
+            const int endX = std::min(width, startX + maxTileSize), endY = std::min(height, startY + maxTileSize);
+            PROFILE_SCOPE("tile");
+            kernel(scene, checkpoint.settings, buffer, maxTileSize * 3, width, height, pass, checkpoint.nextSample, startX, startY, endX, endY, camera, sampler);
+            commitTile(buffer, maxTileSize * 3, frame.data(), width, height, startX, startY, endX, endY);
+        }
+    };
+
+    // One trace frame per pass
+    const uint32_t firstSample = checkpoint.nextSample;
+    const bool tracing = tracePath && startProfiling(workers.size(), static_cast<int>((target - std::min(target, firstSample)) / passSamples + 1));
+    profileThreadName("main");
+
+    auto start = std::chrono::steady_clock::now(), lastSave = start;
+    while (checkpoint.nextSample < target) {
+        pass = static_cast<int>(std::min(static_cast<uint32_t>(passSamples), target - checkpoint.nextSample));
+        {
+            PROFILE_SCOPE("pass");
+            nextTile.store(0);
+            workers.run(job);
+            workers.wait();
+            PROFILE_SCOPE("accumulate");
+            std::fill(samples.begin(), samples.end(), static_cast<float>(pass));
+            checkpoint.accumulator.add(frame.data(), samples.data(), static_cast<float>(1 / exposure));
+        }
+        checkpoint.nextSample += pass;
+        profileFrame();
+
+        const auto now = std::chrono::steady_clock::now();
+        if (checkpoint.nextSample >= target || std::chrono::duration<double>(now - lastSave).count() >= interval) {
+            if (!saveCheckpoint(checkpoint, path)) return 1;
+            lastSave = now;
+            printf("%u/%u samples per pixel after %.1f s, saved %s\n", checkpoint.nextSample, target,
+                std::chrono::duration<double>(now - start).count(), path.c_str());
+        }
+    }
+
+    if (tracing) {
+        stopProfiling();
+        uint64_t totals[NumCounters];
+        profileTotals(totals);
+        const double traced = static_cast<double>(width) * height * (checkpoint.nextSample - firstSample);
+        printf("Per sample: %.2f rays, %.2f shadow rays, %.1f traversal steps, %.1f triangle tests\n", totals[CounterRays] / traced,
+            totals[CounterShadowRays] / traced, totals[CounterTraversalSteps] / traced, totals[CounterTriangleTests] / traced);
+        if (writeProfile(tracePath)) printf("Wrote the trace to %s\n", tracePath);
+    }
+    return 0;
+}
+
+int mergeCheckpoints(int argc, char* argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: --merge <image.pfm> <checkpoint>...\n");
+        return 1;
+    }
+    Checkpoint merged;
+    if (!loadCheckpoint(merged, argv[1])) return 1;
+    std::vector<std::pair<SamplerType, uint32_t>> seeds(1, std::make_pair(merged.samplerType, merged.seed));
+    for (int i = 2; i < argc; ++i) {
+        Checkpoint checkpoint;
+        if (!loadCheckpoint(checkpoint, argv[i])) return 1;
+        if (checkpoint.accumulator.width != merged.accumulator.width || checkpoint.accumulator.height != merged.accumulator.height) {
+            fprintf(stderr, "%s is %dx%d, %s is %dx%d\n", argv[i], checkpoint.accumulator.width, checkpoint.accumulator.height,
+                argv[1], merged.accumulator.width, merged.accumulator.height);
+            return 1;
+        }
+
+        // Clamping, regularization and the depth limits change what a sample converges to
+        if (!sameSettings(checkpoint.settings, merged.settings)) {
+            fprintf(stderr, "%s was rendered with other settings than %s\n", argv[i], argv[1]);
+            return 1;
+        }
+
+        // The same seed draws the same samples, which would count twice without adding anything
+        const auto seed = std::make_pair(checkpoint.samplerType, checkpoint.seed);
+        if (std::find(seeds.begin(), seeds.end(), seed) != seeds.end()) {
+            fprintf(stderr, "%s repeats seed %u of an earlier checkpoint\n", argv[i], checkpoint.seed);
+            return 1;
+        }
+        seeds.push_back(seed);
+        if (checkpoint.scene != merged.scene) {
+            fprintf(stderr, "Warning: %s was rendered from %s, %s from %s\n", argv[i], checkpoint.scene.c_str(), argv[1], merged.scene.c_str());
+        }
+        merged.accumulator.merge(checkpoint.accumulator);
+    }
+
+    const int width = merged.accumulator.width, height = merged.accumulator.height;
+    uint32_t fewest = merged.accumulator.samples(0), most = fewest;
+    for (int i = 1; i < width * height; ++i) {
+        fewest = std::min(fewest, merged.accumulator.samples(i));
+        most = std::max(most, merged.accumulator.samples(i));
+    }
+    std::vector<float> image(width * height * 3);
+    merged.accumulator.resolve(image.data());
+    if (!writePFM(argv[0], image.data(), width, height)) return 1;
+    printf("Merged %d checkpoints into %s, %u to %u samples per pixel\n", argc - 1, argv[0], fewest, most);
+    return 0;
+}
+
+int compareImages(int argc, char* argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: --compare <image.pfm> <reference.pfm> [tolerance]\n");
+        return 1;
+    }
+    const double tolerance = argc > 2 ? atof(argv[2]) : 0.01;
+    int width, height, referenceWidth, referenceHeight;
+    std::vector<float> image, reference;
+    if (!readPFM(argv[0], width, height, image) || !readPFM(argv[1], referenceWidth, referenceHeight, reference)) return 1;
+    if (width != referenceWidth || height != referenceHeight) {
+        fprintf(stderr, "%s is %dx%d, %s is %dx%d\n", argv[0], width, height, argv[1], referenceWidth, referenceHeight);
+        return 1;
+    }
+
+    double error = 0, largest = 0, mean = 0, referenceMean = 0;
+    for (size_t i = 0; i < image.size(); ++i) {
+        const double difference = image[i] - reference[i];
+        error += difference * difference;
+        largest = std::max(largest, std::abs(difference));
+        mean += image[i];
+        referenceMean += reference[i];
+    }
+    const double rmse = sqrt(error / image.size());
+    mean /= image.size();
+    referenceMean /= image.size();
+    const double relative = referenceMean > 0 ? rmse / referenceMean : rmse;
+    const bool identical = memcmp(image.data(), reference.data(), image.size() * sizeof(float)) == 0;
+    printf("%s: %s, rmse %.6g (%.4f%% of the mean), largest difference %.6g, mean %+.4f%%\n", argv[0],
+        identical ? "identical" : relative <= tolerance ? "within tolerance" : "DIFFERS",
+        rmse, 100 * relative, largest, referenceMean > 0 ? 100 * (mean - referenceMean) / referenceMean : 0);
+    return relative <= tolerance ? 0 : 1;
+}
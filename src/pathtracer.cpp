@@ -1,24 +1,54 @@
 #pragma once
 #include "pathtracer.hpp"
+#include "profiler.hpp"
+#include <cstring>
+#include <cstdlib>
+#include <cstdint>
+#include <xmmintrin.h>
 
-std::atomic<int> workersDone = 0;
-constexpr int maxDepth = 2;
-constexpr double rrRate = 0.1;
+constexpr int maxTilePaths = 16384;    // Camera paths traced per tile, bounds the time to notice new input
 
-PathTracer::PathTracer(float* data, int width, int height, Camera& camera, Window& window)
-    : data(data), width(width), height(height), camera(camera), window(window), numThreads(std::thread::hardware_concurrency()) {
+PathTracer::PathTracer(const Scene& scene, float* data, int width, int height, Camera& camera, Window& window, WorkerPool& workers)
+    : pixelSamples(width * height), tilesDone(0), numTiles(0), maxTileTime(0),
+      scene(scene), window(window), camera(camera), workers(workers), data(data), width(width), height(height), numThreads(workers.size()), sampleOffset(0),
+      renderWidth(width), renderHeight(height), target(data), targetSamples(pixelSamples.data()),
+      lowData(width * height * 3), lowSamples(width * height),
+      tileSize(0), tilesX(0) {
+    workerScratch.reserve(numThreads);
+    for (int worker = 0; worker < numThreads; ++worker) {
+        workerScratch.emplace_back(sizeof(WorkerScratch), workers.node(worker));
+    }
 }
 
-void PathTracer::pathTrace(int samps) {
-    memset(data, 0, width * height * 3 * sizeof(float));
-    std::vector<std::thread> workers;
-    int rowsPerWorker = (int)((float)height / numThreads + 0.5);
-    workersDone.store(0);
-    for (int i = 0; i < numThreads; ++i) {
-        workers.emplace_back(std::thread(pathTraceThread, data, width, height, samps, i * rowsPerWorker, min(height, (i + 1) * rowsPerWorker), camera));
-    }
+// Tile edge length keeping the paths traced between two cancellation checks below maxTilePaths.
+static int tileSizeFor(int spp) {
+    int size = maxTileSize;
+    while (size > 4 && size * size * spp > maxTilePaths) size /= 2;
+    return size;
+}
+
+bool PathTracer::pathTrace(int spp, bool preview, int scale) {
+    renderWidth = std::max(1, width / scale);
+    renderHeight = std::max(1, height / scale);
+    target = scale > 1 ? lowData.data() : data;
+    targetSamples = scale > 1 ? lowSamples.data() : pixelSamples.data();
+
+    // Finished tiles overwrite their pixels, the rest of a cancelled frame is ignored for its zero samples
+    std::fill(targetSamples, targetSamples + renderWidth * renderHeight, 0.0f);
+
+    tileSize = tileSizeFor(spp);
+    tilesX = (renderWidth + tileSize - 1) / tileSize;
+    numTiles = tilesX * ((renderHeight + tileSize - 1) / tileSize);
+    nextTile.store(0);
+    finishedTiles.store(0);
+    cancelled.store(false);
 
-    while (workersDone < numThreads) {
+    for (NodeBuffer& scratch : workerScratch) scratch.as<WorkerScratch>()->maxTileTime = 0;
+    TileKernel kernel = tileKernel(kernelFeatures(scene, preview, nextEvent));
+    auto job = [this, spp, kernel](int worker) { pathTraceThread(worker, spp, kernel); };
+    workers.run(job);
+
+    while (!workers.done()) {
         window.proccessMessages();
         if (inFocus) {
             while (ShowCursor(FALSE) > 0);
@@ -27,70 +57,112 @@ void PathTracer::pathTrace(int samps) {
             while (ShowCursor(TRUE) < 0);
         }
     }
+    sampleOffset += spp;
+    tilesDone = finishedTiles.load();
+    maxTileTime = 0;
+    for (const NodeBuffer& scratch : workerScratch) maxTileTime = std::max(maxTileTime, scratch.as<WorkerScratch>()->maxTileTime);
 
-    for (auto& worker : workers) {
-        worker.join();
+    if (scale > 1) {
+        upscale(target, targetSamples, renderWidth, renderHeight, data, pixelSamples.data(), width, height, guideDepth, guideNormal);
     }
+    return !cancelled.load();
 }
 
-void pathTraceThread(float* data, int width, int height, int samps, int startY, int endY, const Camera& camera) {
-    for (int y = startY; y < endY; y++) {
-        for (int x = 0; x < width; x++) {
-            const int i = (height - y - 1) * width + x;
-            for (int sy = 0; sy < (samps == 1 ? 1 : 2); ++sy) {
-                for (int sx = 0; sx < (samps == 1 ? 1 : 2); ++sx) {
-                    Vec r;
-                    for (int s = 0; s < (samps == 1 ? 1 : samps / 2); s++) {
-                        if (newInput.load() && samps > 1) {
-                            ++workersDone;
-                            return;
-                        }
-                        double r1 = 2 * rng(), dx = r1 < 1 ? sqrt(r1) - 1 : 1 - sqrt(2 - r1);
-                        double r2 = 2 * rng(), dy = r2 < 1 ? sqrt(r2) - 1 : 1 - sqrt(2 - r2);
-                        Vec d = camera.u * (((sx + .5) / 2 + x) / width - .5) + camera.v * (((sy + .5) / 2 + y) / height - .5) + camera.w;
-                        r = r + receivedRadiance(Ray(camera.pos, d.normalize()), 1, samps == 1) * (1. / samps / 2);
-                    }
-                    Vec color = Vec(clamp(r.x), clamp(r.y), clamp(r.z)) * (samps == 1 ? 1 : 0.25);
-                    data[i * 3 + 0] += static_cast<float>(color.x);
-                    data[i * 3 + 1] += static_cast<float>(color.y);
-                    data[i * 3 + 2] += static_cast<float>(color.z);
-                }
+void PathTracer::pathTraceThread(int worker, int spp, TileKernel kernel) {
+    WorkerScratch& scratch = *workerScratch[worker].as<WorkerScratch>();
+    Sampler sampler(samplerType);
+    while (true) {
+        // Cancellation is only checked between tiles; single sample frames always finish
+        if (spp > 1 && newInput.load()) {
+            cancelled.store(true);
+            break;
+        }
+        int tile = nextTile++;
+        if (tile >= numTiles) break;
+
+        PROFILE_SCOPE("tile");
+        auto start = std::chrono::high_resolution_clock::now();
+        int startX = (tile % tilesX) * tileSize, startY = (tile / tilesX) * tileSize;
+        int endX = std::min(renderWidth, startX + tileSize), endY = std::min(renderHeight, startY + tileSize);
+        kernel(scene, settings, scratch.tile, maxTileSize * 3, renderWidth, renderHeight, spp, sampleOffset, startX, startY, endX, endY, camera, sampler);
+        commitTile(scratch.tile, maxTileSize * 3, target, renderWidth, renderHeight, startX, startY, endX, endY);
+        for (int y = startY; y < endY; ++y) {
+            for (int x = startX; x < endX; ++x) {
+                targetSamples[(renderHeight - y - 1) * renderWidth + x] = static_cast<float>(spp);
             }
         }
+        ++finishedTiles;
+
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+        scratch.maxTileTime = std::max(scratch.maxTileTime, elapsed.count());
     }
-    ++workersDone;
 }
 
-Vec reflectedRadiance(const Ray& r, int depth, bool firstFrame) {
-    double t;                                   // Distance to intersection
-    int id = 0;                                 // id of intersected sphere
+void commitTile(const float* tile, int stride, float* frame, int width, int height, int startX, int startY, int endX, int endY) {
+    const int count = (endX - startX) * 3;
+    for (int y = startY; y < endY; ++y) {
+        const float* src = tile + (endY - 1 - y) * stride;
+        float* dst = frame + ((height - y - 1) * width + startX) * 3;
 
-    Vec x, n;
-    if (!intersect(r, t, id, &x, &n)) return Vec();   // if miss, return black
-    const Shape* obj = shapes[id];            // the hit object
+        // Streaming stores need 16 byte alignment, row ends that lack it are stored as usual
+        int k = 0;
+        for (; k < count && (reinterpret_cast<uintptr_t>(dst + k) & 15); ++k) dst[k] = src[k];
+        for (; k + 4 <= count; k += 4) _mm_stream_ps(dst + k, _mm_loadu_ps(src + k));
+        for (; k < count; ++k) dst[k] = src[k];
+    }
+    _mm_sfence();
+}
 
-    Vec o = (Vec() - r.d).normalize();          // The outgoing direction (= -r.d)
+bool parseRenderSetting(const char* option, const char* value, RenderSettings& settings) {
+    if (!strcmp(option, "--clamp")) settings.maxBounceRadiance = atof(value);
+    else if (!strcmp(option, "--regularize")) settings.regularization = atof(value);
+    else if (!strcmp(option, "--depth")) settings.maxDepth = atoi(value);
+    else if (!strcmp(option, "--roulette")) settings.rouletteDepth = atoi(value);
+    else return false;
+    return true;
+}
 
-    if (n.dot(o) < 0) n = n * -1.0;
+unsigned kernelFeatures(const Scene& scene, bool preview, bool nextEvent) {
+    unsigned features = scene.hasSpecular ? KernelSpecular : 0;
+    if (!scene.environment.empty()) features |= KernelEnvironment;
+    if (preview) features |= KernelPreview | KernelNextEvent;
+    else if (nextEvent) features |= KernelNextEvent;
+    return features;
+}
 
-    /*
-    Tips
+/*
+ * Kernels are instantiated for every combination of KernelFeature. Features
+ * are template arguments, so the tests on them fold away and kernels without
+ * KernelSpecular call the diffuse BRDF directly.
+ */
 
-    1. Other useful quantities/variables:
-    Vec Le = obj.e;                             // Emitted radiance
-    const BRDF &brdf = obj.brdf;                // Surface BRDF at x
+template <unsigned Features>
+static bool isSpecular(const BRDF& brdf) {
+    return (Features & KernelSpecular) && isDelta(brdf);
+}
 
-    2. Call brdf.sample() to sample an incoming direction and continue the recursion
-    */
+template <unsigned Features>
+static Vec evalMaterial(const BRDF& brdf, const Vec& n, const Vec& o, const Vec& i) {
+    return Features & KernelSpecular ? brdf.eval(n, o, i) : static_cast<const DiffuseBRDF&>(brdf).eval(n, o, i);
+}
+
+// Samples a direction and returns its eval * cos / pdf
+template <unsigned Features>
+static Vec sampleMaterial(const BRDF& brdf, const Vec& n, const Vec& o, Vec& i, Sampler& sampler) {
+    return Features & KernelSpecular ? brdf.sampleWeight(n, o, i, sampler) : static_cast<const DiffuseBRDF&>(brdf).sampleWeight(n, o, i, sampler);
+}
 
-    // Direct radiance
-    int lightId = 0;
-    const Shape* light = shapes[lightId];
+// One-sample estimate of the light reflected towards o from a point on the emitting shape lightId, as seen from shape id
+template <unsigned Features>
+static Vec shapeLight(const Scene& scene, int lightId, int id, const Vec& x, const Vec& n, const Vec& o, const BRDF& brdf, Sampler& sampler) {
+    const Shape* light = scene.shapes[lightId];
 
     // Sample random point on the light source
     Vec y1, ny;
     double pdf1;
-    light->sample(y1, ny, pdf1);
+    light->sample(y1, ny, pdf1, sampler);
+    // Delta lobes reflect no light samples, the point is still drawn so later dimensions stay put
+    if (isSpecular<Features>(brdf)) return Vec();
 
     // Some calculations we need for radiance
     Vec xToY = (y1 - x);
@@ -99,67 +171,233 @@ Vec reflectedRadiance(const Ray& r, int depth, bool firstFrame) {
     double r_sq = (xToY).dot(xToY);
 
     // Mutually visible if rays from each object intersect each other
+    double t;
     int id2;
-    int visibility = intersect(Ray(x, w1), t, id2, 0, 0) && id2 == lightId && intersect(Ray(y1, w1_neg), t, id2, 0, 0) && id2 == id ? 1 : 0;
+    int visibility = scene.intersect(Ray(x, w1), t, id2, 0, 0) && id2 == lightId && scene.intersect(Ray(y1, w1_neg), t, id2, 0, 0) && id2 == id ? 1 : 0;
+    PROFILE_COUNT(CounterShadowRays, 1);
 
     // Final calculation for direct radiance
-    pdf1 *= r_sq / ny.dot(w1_neg);
-    Vec dirRadiance = light->e.mult(obj->brdf.eval(n, w1, o)) * visibility * clamp(n.dot(w1));
-
-    // Russian roulette
-    double p = depth <= maxDepth ? 1 : rrRate;
-
-    if (!firstFrame && rng() < p) {
-        // Sample new direction
-        Vec w2;
-        double pdf2;
-        obj->brdf.sample(n, o, w2, pdf2);
-
-        // Add radiance from new sampled direction
-        Ray y2(x, w2);
-        Vec refRadiance = reflectedRadiance(y2, depth + 1, firstFrame).mult(obj->brdf.eval(n, w2, o)) * clamp(n.dot(w2));
-        return dirRadiance * (1.0 / (pdf1)) + refRadiance * (1.0 / (pdf2 * p));
+    pdf1 *= r_sq / std::abs(ny.dot(w1_neg));      // Emitters are two-sided
+    Vec dirRadiance = light->e.mult(evalMaterial<Features>(brdf, n, o, w1)) * visibility * clamp(n.dot(w1));
+    return dirRadiance * (1.0 / pdf1);
+}
+
+// One-sample estimate of the light reflected from the environment towards o
+template <unsigned Features>
+static Vec environmentLight(const Scene& scene, const Vec& x, const Vec& n, const Vec& o, const BRDF& brdf, Sampler& sampler) {
+    Vec w;
+    double pdf, t;
+    int id;
+    Vec le = scene.environment.sample(w, pdf, sampler);
+    if (pdf <= 0 || n.dot(w) <= 0 || isSpecular<Features>(brdf)) return Vec();
+    PROFILE_COUNT(CounterShadowRays, 1);
+    if (scene.intersect(Ray(x, w), t, id, 0, 0)) return Vec();
+    return le.mult(evalMaterial<Features>(brdf, n, o, w)) * (n.dot(w) / pdf);
+}
+
+// How far a path has come, carried down the recursion
+struct PathState {
+    int bounces;            // Scattering events so far, mirrors and glass included
+    int diffuseBounces;     // Those at surfaces other than mirrors and glass
+    Vec throughput;         // Product of the sample weights and roulette divisions since the camera
+
+    // The path continued through a sample of the given weight, which survived roulette with chance p
+    PathState next(const Vec& weight, double p, bool delta) const {
+        return PathState{ bounces + 1, diffuseBounces + (delta ? 0 : 1), throughput.mult(weight) * (1.0 / p) };
     }
+};
 
-    return dirRadiance * (1.0 / (pdf1));
+/*
+ * Russian roulette on throughput: once past rouletteDepth, a path goes on with
+ * a chance that follows the largest channel of its throughput after the
+ * bounce, so paths that can add little end early and zero-weight samples
+ * end at once. Paths at the depth limit always end.
+ */
+static double survival(const RenderSettings& settings, const PathState& path, const Vec& weight) {
+    if (path.bounces >= std::min(settings.maxDepth, maxPathBounces)) return 0;
+    const Vec throughput = path.throughput.mult(weight);
+    const double largest = std::max(throughput.x, std::max(throughput.y, throughput.z));
+    if (path.bounces < settings.rouletteDepth) return largest > 0 ? 1 : 0;
+    return std::min(settings.rouletteSurvival, largest);
+}
+
+template <unsigned Features>
+static Vec receivedRadiance(const Scene& scene, const RenderSettings& settings, const Ray& r, const PathState& path, Sampler& sampler);
+template <unsigned Features>
+static Vec reflectedRadiance(const Scene& scene, const RenderSettings& settings, const Ray& r, const PathState& path, Sampler& sampler);
+
+template <unsigned Features>
+static void pathTraceTile(const Scene& scene, const RenderSettings& settings, float* tile, int stride, int width, int height, int spp, uint32_t sampleOffset, int startX, int startY, int endX, int endY, const Camera& camera, Sampler& sampler) {
+    // 2x2 sub-pixels once there are enough samples to fill them
+    const int grid = spp >= 4 ? 2 : 1;
+    const int subSamps = spp / (grid * grid);
+    const PathState cameraPath{ 0, 0, Vec(1, 1, 1) };
+    for (int y = startY; y < endY; y++) {
+        for (int x = startX; x < endX; x++) {
+            float pixel[3] = { 0, 0, 0 };
+            for (int sy = 0; sy < grid; ++sy) {
+                for (int sx = 0; sx < grid; ++sx) {
+                    Vec r;
+                    for (int s = 0; s < subSamps; s++) {
+                        sampler.startPixelSample(x, y, sampleOffset + (sy * grid + sx) * subSamps + s);
+
+                        // Tent filter jitter within the sub-pixel
+                        double r1, r2;
+                        sampler.get2D(r1, r2);
+                        r1 *= 2, r2 *= 2;
+                        double dx = r1 < 1 ? sqrt(r1) - 1 : 1 - sqrt(2 - r1);
+                        double dy = r2 < 1 ? sqrt(r2) - 1 : 1 - sqrt(2 - r2);
+                        Vec d = camera.u * (((sx + .5 + dx) / grid + x) / width - .5) + camera.v * (((sy + .5 + dy) / grid + y) / height - .5) + camera.w;
+                        r = r + receivedRadiance<Features>(scene, settings, Ray(camera.pos, d.normalize()), cameraPath, sampler) * (exposure / subSamps);
+                    }
+                    Vec color = r * (1.0 / (grid * grid));
+                    pixel[0] += static_cast<float>(color.x);
+                    pixel[1] += static_cast<float>(color.y);
+                    pixel[2] += static_cast<float>(color.z);
+                }
+            }
+            float* out = tile + (endY - 1 - y) * stride + (x - startX) * 3;
+            out[0] = pixel[0], out[1] = pixel[1], out[2] = pixel[2];
+        }
+    }
+}
+
+// Scales c down to at most limit in every channel, keeping its hue; no limit if it is 0
+static Vec clampBounce(const Vec& c, double limit) {
+    const double largest = std::max(c.x, std::max(c.y, c.z));
+    return limit > 0 && largest > limit ? c * (limit / largest) : c;
+}
+
+// Direct light and one further bounce scattered towards o at x by brdf
+template <unsigned Features>
+static Vec scatteredRadiance(const Scene& scene, const RenderSettings& settings, int id, const Vec& x, const Vec& n, const Vec& shapeNormal, const Vec& o, const BRDF& brdf, const PathState& path, Sampler& sampler) {
+    // Direct radiance from one light picked uniformly, the environment counting as one, so the
+    // estimate is divided by the pick's probability of 1 / numLights
+    const int numShapeLights = static_cast<int>(scene.lights.size());
+    const int numLights = numShapeLights + (Features & KernelEnvironment ? 1 : 0);
+    if (numLights == 0) return Vec();
+    const int pick = std::min(numLights - 1, static_cast<int>(sampler.get1D() * numLights));
+    Vec direct;
+    if (pick == numShapeLights) {
+        direct = environmentLight<Features>(scene, x, n, o, brdf, sampler);
+    }
+    else {
+        direct = shapeLight<Features>(scene, scene.lights[pick], id, x, n, o, brdf, sampler);
+    }
+    direct = direct * numLights;
+
+    if (Features & KernelPreview) return direct;
+
+    // Sample new direction, then Russian roulette
+    Vec w2;
+    Vec weight = sampleMaterial<Features>(brdf, shapeNormal, o, w2, sampler);
+    const double p = survival(settings, path, weight);
+    if (p <= 0 || sampler.get1D() >= p) return direct;
+
+    // Add radiance from new sampled direction
+    Ray y2(x, w2);
+    Vec refRadiance = clampBounce(reflectedRadiance<Features>(scene, settings, y2, path.next(weight, p, false), sampler), settings.maxBounceRadiance).mult(weight);
+    return direct + refRadiance * (1.0 / p);
+}
+
+template <unsigned Features>
+static Vec reflectedRadiance(const Scene& scene, const RenderSettings& settings, const Ray& r, const PathState& path, Sampler& sampler) {
+    double t;                                   // Distance to intersection
+    int id = 0;                                 // id of intersected sphere
+
+    Vec x, n;
+    if (!scene.intersect(r, t, id, &x, &n)) return Vec();   // if miss, return black
+    const Shape* obj = scene.shapes[id];      // the hit object
+
+    Vec o = (Vec() - r.d).normalize();          // The outgoing direction (= -r.d)
+
+    const Vec shapeNormal = n;                  // Unflipped, glass tells entering from leaving by it
+    if (n.dot(o) < 0) n = n * -1.0;
+
+    /*
+    Tips
+
+    1. Other useful quantities/variables:
+    Vec Le = obj.e;                             // Emitted radiance
+    const BRDF &brdf = obj.brdf;                // Surface BRDF at x
+
+    2. Call brdf.sample() to sample an incoming direction and continue the recursion
+    */
+
+    // Past the first diffuse bounce, regularization widens mirrors and smoother glossy lobes so
+    // the lights can be sampled through them, trading the fireflies of caustic paths for blur
+    const double roughness = settings.regularization;
+    if ((Features & KernelSpecular) && roughness > 0 && path.diffuseBounces > 0) {
+        const BRDF& brdf = obj->brdf;
+        if (brdf.type == BRDFType::Specular) {
+            const ConductorBRDF widened(static_cast<const SpecularBRDF&>(brdf).ks, roughness);
+            return scatteredRadiance<Features>(scene, settings, id, x, n, shapeNormal, o, widened, path, sampler);
+        }
+        if (brdf.type == BRDFType::Conductor && static_cast<const ConductorBRDF&>(brdf).ggx.alpha < roughness * roughness) {
+            const ConductorBRDF widened(static_cast<const ConductorBRDF&>(brdf).f0, roughness);
+            return scatteredRadiance<Features>(scene, settings, id, x, n, shapeNormal, o, widened, path, sampler);
+        }
+        if (brdf.type == BRDFType::Plastic && static_cast<const PlasticBRDF&>(brdf).ggx.alpha < roughness * roughness) {
+            const PlasticBRDF& plastic = static_cast<const PlasticBRDF&>(brdf);
+            const PlasticBRDF widened(plastic.kd, roughness, plastic.ior);
+            return scatteredRadiance<Features>(scene, settings, id, x, n, shapeNormal, o, widened, path, sampler);
+        }
+    }
+    return scatteredRadiance<Features>(scene, settings, id, x, n, shapeNormal, o, obj->brdf, path, sampler);
 }
 
 /*
  * KEY FUNCTION: radiance estimator
  */
 
-Vec receivedRadiance(const Ray& r, int depth, bool firstFrame) {
+template <unsigned Features>
+static Vec receivedRadiance(const Scene& scene, const RenderSettings& settings, const Ray& r, const PathState& path, Sampler& sampler) {
     double t;                                   // Distance to intersection
     int id = 0;                                 // id of intersected sphere
 
     Vec x, n;
-    if (!intersect(r, t, id, &x, &n)) return Vec();   // if miss, return black
-    const Shape* obj = shapes[id];            // the hit object
+    if (!scene.intersect(r, t, id, &x, &n)) {   // if miss, return the environment
+        return Features & KernelEnvironment ? scene.environment.radiance(r.d) : Vec();
+    }
+    const Shape* obj = scene.shapes[id];      // the hit object
 
     Vec o = (Vec() - r.d).normalize();          // The outgoing direction (= -r.d)
 
+    const Vec shapeNormal = n;                  // Unflipped, glass tells entering from leaving by it
     if (n.dot(o) < 0) n = n * -1.0;
 
-    // If specular, use the radiance calculation from task 2
-    if (obj->brdf.isSpecular()) {
+    // Mirrors, glass and the smoothest glossy lobes, and every surface when the lights aren't sampled, continue along a BRDF sample
+    // and count the emission of whatever they hit
+    const bool specular = isSpecular<Features>(obj->brdf);
+    if (specular || !(Features & KernelNextEvent)) {
         // Emitted radiance
         Vec rad = obj->e;
 
-        // Russian roulette
-        double p = depth <= maxDepth ? 1 : rrRate;
-        if (!firstFrame && rng() < p) {
-            // Sample new direction
-            Vec i;
-            double pdf;
-            obj->brdf.sample(n, o, i, pdf);
-            Ray Y(x, i);
-
-            // Add radiance from new sampled direction
-            rad = rad + receivedRadiance(Y, depth, firstFrame).mult(obj->brdf.eval(n, o, i)) * (clamp(n.dot(i)) / (pdf * p));
-        }
-        return rad;
+        if (Features & KernelPreview) return rad;
+
+        // Sample new direction, then Russian roulette
+        Vec i;
+        Vec weight = sampleMaterial<Features>(obj->brdf, shapeNormal, o, i, sampler);
+        const double p = survival(settings, path, weight);
+        if (p <= 0 || sampler.get1D() >= p) return rad;
+        Ray Y(x, i);
+
+        // Add radiance from new sampled direction, light seen through mirrors and glass isn't clamped
+        Vec incoming = receivedRadiance<Features>(scene, settings, Y, path.next(weight, p, specular), sampler);
+        if (!specular) incoming = clampBounce(incoming, settings.maxBounceRadiance);
+        return rad + incoming.mult(weight) * (1.0 / p);
     }
 
     // Otherwise, use our next event estimation
-    return obj->e + reflectedRadiance(r, depth, firstFrame);
-}
\ No newline at end of file
+    return obj->e + reflectedRadiance<Features>(scene, settings, r, path, sampler);
+}
+
+TileKernel tileKernel(unsigned features) {
+    static const TileKernel kernels[] = {
+        pathTraceTile<0>, pathTraceTile<1>, pathTraceTile<2>, pathTraceTile<3>,
+        pathTraceTile<4>, pathTraceTile<5>, pathTraceTile<6>, pathTraceTile<7>,
+        pathTraceTile<8>, pathTraceTile<9>, pathTraceTile<10>, pathTraceTile<11>,
+        pathTraceTile<12>, pathTraceTile<13>, pathTraceTile<14>, pathTraceTile<15>,
+    };
+    return kernels[features & 15];
+}
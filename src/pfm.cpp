@@ -0,0 +1,63 @@
+#pragma once
+#include "pfm.hpp"
+#include <fstream>
+#include <iostream>
+#include <cstring>
+#include <cstdint>
+
+// The sign of the scale marks little-endian floats
+bool readPFM(std::istream& in, int& width, int& height, std::vector<float>& rgb) {
+    std::string magic;
+    double byteOrder;
+    if (!(in >> magic >> width >> height >> byteOrder) || (magic != "PF" && magic != "Pf") || width <= 0 || height <= 0) return false;
+    in.get();
+
+    const int channels = magic == "PF" ? 3 : 1;
+    const bool swap = byteOrder > 0;
+    rgb.resize(static_cast<size_t>(width) * height * 3);
+    std::vector<float> row(static_cast<size_t>(width) * channels);
+    for (int y = height - 1; y >= 0; --y) {
+        if (!in.read(reinterpret_cast<char*>(row.data()), row.size() * sizeof(float))) return false;
+        float* out = &rgb[static_cast<size_t>(y) * width * 3];
+        for (size_t k = 0; k < row.size(); ++k) {
+            if (swap) {
+                uint32_t bits;
+                memcpy(&bits, &row[k], sizeof(bits));
+                bits = (bits >> 24) | ((bits >> 8) & 0xff00) | ((bits << 8) & 0xff0000) | (bits << 24);
+                memcpy(&row[k], &bits, sizeof(bits));
+            }
+        }
+        for (int x = 0; x < width; ++x) {
+            for (int c = 0; c < 3; ++c) {
+                out[x * 3 + c] = row[x * channels + (channels == 3 ? c : 0)];
+            }
+        }
+    }
+    return true;
+}
+
+bool readPFM(const std::string& path, int& width, int& height, std::vector<float>& rgb) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        std::cerr << "Error opening file: " << path << "\n";
+        return false;
+    }
+    if (!readPFM(file, width, height, rgb)) {
+        std::cerr << path << ": not a PFM image\n";
+        return false;
+    }
+    return true;
+}
+
+bool writePFM(const std::string& path, const float* rgb, int width, int height) {
+    std::ofstream file(path, std::ios::binary);
+    if (!file) {
+        std::cerr << "Error opening file: " << path << "\n";
+        return false;
+    }
+    file << "PF\n" << width << " " << height << "\n-1\n";
+    for (int y = height - 1; y >= 0; --y) {
+        file.write(reinterpret_cast<const char*>(rgb + static_cast<size_t>(y) * width * 3), width * 3 * sizeof(float));
+    }
+    return static_cast<bool>(file);
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include "plane.hpp"
+
+Plane::Plane(Vec p_, Vec n_, Vec e_, const BRDF& brdf_)
+    : Shape(brdf_, e_), p(p_), n(n_.normalize()) {}
+
+double Plane::intersect(const Ray& r, Vec* point, Vec* normal) const {
+    const double denom = n.dot(r.d);
+    if (denom == 0) return 0;
+    const double t = n.dot(p - r.o) / denom;
+    if (t <= 1e-8) return 0;    // Same bound as triangles, rays leaving the plane start at t ~ 0
+    if (point && normal) {
+        *point = r.o + r.d * t;
+        *normal = n;
+    }
+    return t;
+}
+
+void Plane::sample(Vec& point, Vec& normal, double& pdf, Sampler& sampler) const {
+    // Never used: scene files give planes no emission, so they are never lights
+    point = p;
+    normal = n;
+    pdf = 0;
+}
+
+AABB Plane::bounds() const {
+    return AABB(Vec(-INFINITY, -INFINITY, -INFINITY), Vec(INFINITY, INFINITY, INFINITY));
+}
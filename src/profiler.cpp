@@ -0,0 +1,171 @@
+#pragma once
+#include "profiler.hpp"
+#include <cstdio>
+
+#ifdef ENABLE_PROFILING
+#include <atomic>
+#include <vector>
+#include <fstream>
+#include <iostream>
+
+constexpr int maxProfileThreads = 256;
+static const char* const counterNames[NumCounters] = { "rays", "shadow rays", "traversal steps", "triangle tests" };
+
+struct ProfileEvent {
+    const char* name;
+    std::chrono::steady_clock::time_point start, end;
+};
+
+struct ProfileFrame {
+    std::chrono::steady_clock::time_point time;
+    uint64_t counters[NumCounters];
+};
+
+struct ProfileSlot {
+    uint64_t counters[NumCounters] = {};
+    std::vector<ProfileEvent> events;   // Capacity reserved up front, never grown while recording
+    const char* name = nullptr;
+};
+
+static ProfileSlot slots[maxProfileThreads];
+static std::atomic<int> numSlots(0);
+static std::atomic<bool> recording(false);
+static std::atomic<long long> dropped(0);
+static std::vector<ProfileFrame> frames;
+static uint64_t lastTotals[NumCounters];
+static std::chrono::steady_clock::time_point origin;
+
+thread_local uint64_t* threadCounters = nullptr;
+static thread_local int threadSlot = -1;
+
+// Threads past the last slot share it, their counts may then race
+static int slotOfThread() {
+    if (threadSlot < 0) {
+        threadSlot = numSlots++;
+        if (threadSlot >= maxProfileThreads) threadSlot = maxProfileThreads - 1;
+    }
+    return threadSlot;
+}
+
+uint64_t* claimProfileSlot() {
+    threadCounters = slots[slotOfThread()].counters;
+    return threadCounters;
+}
+
+ProfileScope::~ProfileScope() {
+    if (!recording.load(std::memory_order_relaxed)) return;
+    std::vector<ProfileEvent>& events = slots[slotOfThread()].events;
+    if (events.size() < events.capacity()) {
+        events.push_back({ name, start, std::chrono::steady_clock::now() });
+    }
+    else {
+        ++dropped;
+    }
+}
+
+bool startProfiling(int threads, int numFrames, int eventsPerThread) {
+    // The calling thread and the input thread come on top of the workers
+    const int reserved = threads + 2 < maxProfileThreads ? threads + 2 : maxProfileThreads;
+    for (int i = 0; i < maxProfileThreads; ++i) {
+        slots[i].events.clear();
+        if (i < reserved) slots[i].events.reserve(eventsPerThread);
+        for (uint64_t& counter : slots[i].counters) counter = 0;
+    }
+    frames.clear();
+    frames.reserve(numFrames);
+    for (uint64_t& total : lastTotals) total = 0;
+    dropped.store(0);
+    origin = std::chrono::steady_clock::now();
+    recording.store(true);
+    return true;
+}
+
+void stopProfiling() {
+    recording.store(false);
+}
+
+void profileThreadName(const char* name) {
+    slots[slotOfThread()].name = name;
+}
+
+void profileTotals(uint64_t* totals) {
+    const int used = numSlots.load() < maxProfileThreads ? numSlots.load() : maxProfileThreads;
+    for (int c = 0; c < NumCounters; ++c) totals[c] = 0;
+    for (int i = 0; i < used; ++i) {
+        for (int c = 0; c < NumCounters; ++c) totals[c] += slots[i].counters[c];
+    }
+}
+
+void profileFrame() {
+    if (!recording.load() || frames.size() == frames.capacity()) return;
+    ProfileFrame frame;
+    frame.time = std::chrono::steady_clock::now();
+    uint64_t totals[NumCounters];
+    profileTotals(totals);
+    for (int c = 0; c < NumCounters; ++c) {
+        frame.counters[c] = totals[c] - lastTotals[c];
+        lastTotals[c] = totals[c];
+    }
+    frames.push_back(frame);
+}
+
+static double microseconds(std::chrono::steady_clock::time_point t) {
+    return std::chrono::duration<double, std::micro>(t - origin).count();
+}
+
+bool writeProfile(const std::string& path) {
+    std::ofstream file(path);
+    if (!file) {
+        std::cerr << "Error opening file: " << path << "\n";
+        return false;
+    }
+    char line[256];
+    const char* separator = "";
+    file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    const int used = numSlots.load() < maxProfileThreads ? numSlots.load() : maxProfileThreads;
+    for (int i = 0; i < used; ++i) {
+        if (slots[i].name) {
+            snprintf(line, sizeof(line), "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%d,\"args\":{\"name\":\"%s\"}}", separator, i, slots[i].name);
+            file << line;
+            separator = ",";
+        }
+        for (const ProfileEvent& event : slots[i].events) {
+            snprintf(line, sizeof(line), "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                separator, event.name, i, microseconds(event.start), microseconds(event.end) - microseconds(event.start));
+            file << line;
+            separator = ",";
+        }
+    }
+    for (const ProfileFrame& frame : frames) {
+        snprintf(line, sizeof(line), "%s\n{\"name\":\"per frame\",\"ph\":\"C\",\"pid\":0,\"ts\":%.3f,\"args\":{", separator, microseconds(frame.time));
+        file << line;
+        for (int c = 0; c < NumCounters; ++c) {
+            file << (c ? "," : "") << "\"" << counterNames[c] << "\":" << frame.counters[c];
+        }
+        file << "}}";
+        separator = ",";
+    }
+    file << "\n]}\n";
+    if (dropped.load()) {
+        printf("Trace buffers were full, %lld events dropped\n", dropped.load());
+    }
+    return static_cast<bool>(file);
+}
+#else
+bool startProfiling(int threads, int frames, int eventsPerThread) {
+    fprintf(stderr, "Built without ENABLE_PROFILING, nothing is recorded\n");
+    return false;
+}
+
+void stopProfiling() {}
+void profileThreadName(const char* name) {}
+void profileFrame() {}
+
+void profileTotals(uint64_t* totals) {
+    for (int c = 0; c < NumCounters; ++c) totals[c] = 0;
+}
+
+bool writeProfile(const std::string& path) {
+    return false;
+}
+#endif
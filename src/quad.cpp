@@ -0,0 +1,47 @@
+#pragma once
+#include "quad.hpp"
+
+Quad::Quad(Vec corner_, Vec u_, Vec v_, Vec e_, const BRDF& brdf_)
+    : Shape(brdf_, e_), corner(corner_), u(u_), v(v_) {
+    Vec c = u.cross(v);
+    area = c.length();
+    n = c * (1.0 / area);
+    w = c * (1.0 / c.dot(c));
+}
+
+double Quad::intersect(const Ray& r, Vec* point, Vec* normal) const {
+    const double denom = n.dot(r.d);
+    if (denom == 0) return 0;
+    const double t = n.dot(corner - r.o) / denom;
+    if (t <= 1e-8) return 0;    // Same bound as triangles, rays leaving the quad start at t ~ 0
+
+    // Edge coordinates of the hit point, both in [0, 1] inside
+    const Vec hit = r.o + r.d * t;
+    const Vec q = hit - corner;
+    const double alpha = w.dot(q.cross(v));
+    const double beta = w.dot(u.cross(q));
+    if (alpha < 0 || alpha > 1 || beta < 0 || beta > 1) return 0;
+
+    if (point && normal) {
+        *point = hit;
+        *normal = n;
+    }
+    return t;
+}
+
+void Quad::sample(Vec& point, Vec& normal, double& pdf, Sampler& sampler) const {
+    double xi1, xi2;
+    sampler.get2D(xi1, xi2);
+    point = corner + u * xi1 + v * xi2;
+    normal = n;
+    pdf = 1.0 / area;
+}
+
+AABB Quad::bounds() const {
+    AABB box;
+    box.expand(corner);
+    box.expand(corner + u);
+    box.expand(corner + v);
+    box.expand(corner + u + v);
+    return box;
+}
@@ -0,0 +1,81 @@
+#pragma once
+#include "sampler.hpp"
+
+constexpr double toUnit = 1.0 / 4294967296.0;  // 2^-32
+
+static uint32_t hash(uint32_t x) {
+    x ^= x >> 16; x *= 0x7feb352du;
+    x ^= x >> 15; x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+static uint32_t hashCombine(uint32_t seed, uint32_t v) {
+    return seed ^ (hash(v) + 0x9e3779b9u + (seed << 6) + (seed >> 2));
+}
+
+static uint32_t reverseBits(uint32_t x) {
+    x = (x << 16) | (x >> 16);
+    x = ((x & 0x00ff00ffu) << 8) | ((x & 0xff00ff00u) >> 8);
+    x = ((x & 0x0f0f0f0fu) << 4) | ((x & 0xf0f0f0f0u) >> 4);
+    x = ((x & 0x33333333u) << 2) | ((x & 0xccccccccu) >> 2);
+    x = ((x & 0x55555555u) << 1) | ((x & 0xaaaaaaaau) >> 1);
+    return x;
+}
+
+/*
+ * Hash-based Owen scrambling (Burley, "Practical Hash-based Owen Scrambling", 2020)
+ */
+
+static uint32_t laineKarrasPermutation(uint32_t x, uint32_t seed) {
+    x += seed;
+    x ^= x * 0x6c50b47cu;
+    x ^= x * 0xb82f1e52u;
+    x ^= x * 0xc7afe638u;
+    x ^= x * 0x8d22f6e6u;
+    return x;
+}
+
+static uint32_t nestedUniformScramble(uint32_t x, uint32_t seed) {
+    return reverseBits(laineKarrasPermutation(reverseBits(x), seed));
+}
+
+// First two Sobol' dimensions: van der Corput and its Pascal-matrix partner.
+static uint32_t sobol(uint32_t index, int dim) {
+    if (dim == 0) return reverseBits(index);
+    uint32_t v = 1u << 31, result = 0;
+    for (; index; index >>= 1, v ^= v >> 1) {
+        if (index & 1) result ^= v;
+    }
+    return result;
+}
+
+Sampler::Sampler(SamplerType type, uint32_t seed)
+    : type(type), seed(seed), pixelSeed(0), index(0), dimension(0) {}
+
+void Sampler::startPixelSample(int x, int y, uint32_t sampleIndex) {
+    pixelSeed = hashCombine(hashCombine(hash(seed), static_cast<uint32_t>(x)), static_cast<uint32_t>(y));
+    index = sampleIndex;
+    dimension = 0;
+}
+
+double Sampler::get1D() {
+    uint32_t dimSeed = hashCombine(pixelSeed, dimension++);
+    if (type == SamplerType::Independent) {
+        return hash(hashCombine(dimSeed, index)) * toUnit;
+    }
+    uint32_t i = nestedUniformScramble(index, dimSeed);
+    return nestedUniformScramble(sobol(i, 0), hash(dimSeed)) * toUnit;
+}
+
+void Sampler::get2D(double& u1, double& u2) {
+    uint32_t dimSeed = hashCombine(pixelSeed, dimension++);
+    if (type == SamplerType::Independent) {
+        u1 = hash(hashCombine(dimSeed, index)) * toUnit;
+        u2 = hash(hashCombine(dimSeed ^ 0x5bd1e995u, index)) * toUnit;
+        return;
+    }
+    uint32_t i = nestedUniformScramble(index, dimSeed);
+    u1 = nestedUniformScramble(sobol(i, 0), hashCombine(dimSeed, 0)) * toUnit;
+    u2 = nestedUniformScramble(sobol(i, 1), hashCombine(dimSeed, 1)) * toUnit;
+}
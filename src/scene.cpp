@@ -1,46 +1,277 @@
 #pragma once
 #include "scene.hpp"
+#include "profiler.hpp"
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <iostream>
+#include <chrono>
 
-/*
- * Scene configuration
- */
-
- // Pre-defined BRDFs
-const DiffuseBRDF leftWall(Vec(.75, .25, .25)),
-rightWall(Vec(.25, .25, .75)),
-otherWall(Vec(.75, .75, .75)),
-greenSurf(Vec(.25, .75, .25)),
-orangeSurf(Vec(.75, .5, .25)),
-yellowSurf(Vec(.75, .75, .25)),
-cyanSurf(Vec(.25, .75, .75)),
-magentaSurf(Vec(.75, .25, .75)),
-blackSurf(Vec(0.0, 0.0, 0.0)),
-brightSurf(Vec(0.9, 0.9, 0.9));
-const SpecularBRDF shinySurf(Vec(0.999, 0.999, 0.999));
-
-// Scene: list of shapes
-const Shape* shapes[] = {
-    new Sphere(0.5, Vec(0, 8, 2),      Vec(150,150,150), blackSurf),   // Light
-    new Sphere(1e5,  Vec(1e5 + 5, 0, 0),   Vec(),         leftWall),   // Left
-    new Sphere(1e5,  Vec(-1e5 - 5, 0, 0), Vec(),         rightWall),  // Right
-    new Sphere(1e5,  Vec(0, 0, -1e5 - 5),      Vec(),         otherWall),  // Back
-    new Sphere(1e5,  Vec(0, -1e5, 0),     Vec(),         otherWall),  // Bottom
-    new Sphere(1e5,  Vec(0, 1e5 + 10, 0), Vec(),         otherWall),  // Top
-    new STLModel("rsrc/models/octahedron.stl", greenSurf, Vec(2, 2, 2), Vec(), true, 4),
-    new Sphere(2.5,  Vec(-2, 2.5, -2), Vec(), orangeSurf),
+struct MaterialDesc {
+    std::string kind, name;
+    Vec color;
+    double roughness, ior;
 };
 
-bool intersect(const Ray& r, double& t, int& id, Vec* point, Vec* normal) {
-    double d, inf = t = 1e20;
-    int n = sizeof(shapes) / sizeof(void*);
+struct ShapeDesc {
+    std::string kind, material, mesh;
+    double radius, scale;
+    Vec pos, rotation, e;
+    Vec u, v;   // Plane normal, or quad edges
+};
+
+Scene::Scene() : cameraPos(0, 5, 15) {}
+
+void Scene::clear() {
+    shapes.clear();
+    lights.clear();
+    hasSpecular = false;
+    environment.clear();
+    materials.clear();
+    objects.clear();
+    instanceById.clear();
+    bounded.clear();
+    unbounded.clear();
+    primitiveOf.clear();
+    shapeBounds.clear();
+    dirty.clear();
+    bvh = BVH();
+}
+
+bool Scene::load(const std::string& filepath) {
+    std::ifstream file(filepath);
+    if (!file) {
+        std::cerr << "Error opening scene: " << filepath << "\n";
+        return false;
+    }
+    return load(file, filepath);
+}
+
+bool Scene::load(std::istream& file, const std::string& filepath) {
+    // Parse every directive before building, so the arrays can be sized up front
+    std::vector<MaterialDesc> materialDescs;
+    std::vector<ShapeDesc> shapeDescs;
+    std::map<std::string, std::string> meshPaths;
+    std::string environmentPath;
+    double environmentScale = 1;
+    std::string line;
+    for (int lineNumber = 1; std::getline(file, line); ++lineNumber) {
+        line = line.substr(0, line.find('#'));
+        std::istringstream in(line);
+        std::string keyword;
+        if (!(in >> keyword)) continue;
+
+        bool ok;
+        if (keyword == "camera") {
+            ok = static_cast<bool>(in >> cameraPos.x >> cameraPos.y >> cameraPos.z);
+        }
+        else if (keyword == "diffuse" || keyword == "specular" || keyword == "conductor" || keyword == "plastic" || keyword == "glass") {
+            MaterialDesc m;
+            m.kind = keyword;
+            m.roughness = 0;
+            m.ior = 1.5;
+            in >> m.name >> m.color.x >> m.color.y >> m.color.z;
+            if (keyword == "conductor" || keyword == "plastic") in >> m.roughness;
+            ok = static_cast<bool>(in);
+            if ((keyword == "plastic" || keyword == "glass") && ok && in >> m.ior) {
+                ok = m.ior > 0;
+            }
+            materialDescs.push_back(m);
+        }
+        else if (keyword == "environment") {
+            ok = static_cast<bool>(in >> std::quoted(environmentPath));
+            if (ok && !(in >> environmentScale)) environmentScale = 1;
+        }
+        else if (keyword == "mesh") {
+            std::string name, path;
+            ok = static_cast<bool>(in >> name >> std::quoted(path));
+            meshPaths[name] = path;
+        }
+        else if (keyword == "sphere" || keyword == "model" || keyword == "instance") {
+            ShapeDesc s;
+            s.kind = keyword == "sphere" ? keyword : "instance";
+            s.radius = s.scale = 1;
+            in >> s.material;
+            if (keyword == "sphere") in >> s.radius;
+            else in >> std::quoted(s.mesh);
+            in >> s.pos.x >> s.pos.y >> s.pos.z;
+            if (keyword != "sphere") in >> s.scale;
+            ok = static_cast<bool>(in);
+            if (keyword == "instance" && ok && in >> s.rotation.x) {
+                ok = static_cast<bool>(in >> s.rotation.y >> s.rotation.z);
+            }
+            if (ok && in >> s.e.x) {
+                ok = static_cast<bool>(in >> s.e.y >> s.e.z);
+            }
+            // A model names its mesh by path
+            if (keyword == "model") {
+                meshPaths[s.mesh] = s.mesh;
+            }
+            shapeDescs.push_back(s);
+        }
+        else if (keyword == "plane" || keyword == "quad") {
+            ShapeDesc s;
+            s.kind = keyword;
+            s.radius = s.scale = 1;
+            in >> s.material >> s.pos.x >> s.pos.y >> s.pos.z >> s.u.x >> s.u.y >> s.u.z;
+            if (keyword == "quad") in >> s.v.x >> s.v.y >> s.v.z;
+            ok = static_cast<bool>(in);
+            if (keyword == "quad" && ok && in >> s.e.x) {
+                ok = static_cast<bool>(in >> s.e.y >> s.e.z);
+            }
+            shapeDescs.push_back(s);
+        }
+        else {
+            ok = false;
+        }
+
+        if (!ok) {
+            std::cerr << filepath << ":" << lineNumber << ": invalid directive: " << line << "\n";
+            clear();
+            return false;
+        }
+    }
+
+    // Meshes, each file loaded once
+    clear();
+    std::map<std::string, const STLModel*> meshByPath, meshByName;
+    for (const auto& mesh : meshPaths) {
+        auto loaded = meshByPath.find(mesh.second);
+        if (loaded == meshByPath.end()) {
+            loaded = meshByPath.emplace(mesh.second, objects.make<STLModel>(mesh.second)).first;
+            if (loaded->second->triangles.empty()) {
+                clear();
+                return false;
+            }
+        }
+        meshByName[mesh.first] = loaded->second;
+    }
+    if (!environmentPath.empty() && !environment.load(environmentPath, environmentScale)) {
+        clear();
+        return false;
+    }
+
+    // Materials, then the shapes right after them
+    for (const auto& m : materialDescs) {
+        if (m.kind == "specular") {
+            materials[m.name] = objects.make<SpecularBRDF>(m.color);
+        }
+        else if (m.kind == "conductor") {
+            materials[m.name] = objects.make<ConductorBRDF>(m.color, m.roughness);
+        }
+        else if (m.kind == "plastic") {
+            materials[m.name] = objects.make<PlasticBRDF>(m.color, m.roughness, m.ior);
+        }
+        else if (m.kind == "glass") {
+            materials[m.name] = objects.make<DielectricBRDF>(m.color, m.ior);
+        }
+        else {
+            materials[m.name] = objects.make<DiffuseBRDF>(m.color);
+        }
+    }
+
+    for (const auto& s : shapeDescs) {
+        auto material = materials.find(s.material);
+        if (material == materials.end()) {
+            std::cerr << filepath << ": unknown material: " << s.material << "\n";
+            clear();
+            return false;
+        }
+
+        hasSpecular |= material->second->type != BRDFType::Diffuse;
+        Instance* instance = nullptr;
+        if (s.kind == "sphere") {
+            shapes.push_back(objects.make<Sphere>(s.radius, s.pos, s.e, *material->second));
+        }
+        else if (s.kind == "plane") {
+            shapes.push_back(objects.make<Plane>(s.pos, s.u, s.e, *material->second));
+        }
+        else if (s.kind == "quad") {
+            shapes.push_back(objects.make<Quad>(s.pos, s.u, s.v, s.e, *material->second));
+        }
+        else {
+            auto mesh = meshByName.find(s.mesh);
+            if (mesh == meshByName.end()) {
+                std::cerr << filepath << ": unknown mesh: " << s.mesh << "\n";
+                clear();
+                return false;
+            }
+            instance = objects.make<Instance>(*mesh->second, Transform(s.pos, s.scale, s.rotation), s.e, *material->second);
+            shapes.push_back(instance);
+        }
+        instanceById.push_back(instance);
+        if (s.e.x > 0 || s.e.y > 0 || s.e.z > 0) {
+            lights.push_back(static_cast<int>(shapes.size()) - 1);
+        }
+    }
+    build();
+    return true;
+}
+
+void Scene::build() {
+    primitiveOf.assign(shapes.size(), -1);
+    for (size_t i = 0; i < shapes.size(); ++i) {
+        AABB box = shapes[i]->bounds();
+        if (box.unbounded()) {
+            unbounded.push_back(static_cast<int>(i));
+            continue;
+        }
+        primitiveOf[i] = static_cast<int>(bounded.size());
+        bounded.push_back(static_cast<int>(i));
+        shapeBounds.push_back(box);
+    }
+    bvh.build(shapeBounds);
+    builtCost = bvh.cost();
+}
+
+bool Scene::setTransform(int id, const Transform& toWorld) {
+    if (id < 0 || id >= static_cast<int>(shapes.size()) || !instanceById[id]) return false;
+    instanceById[id]->setTransform(toWorld);
+    dirty.push_back(id);
+    return true;
+}
+
+void Scene::update() {
+    if (dirty.empty()) return;
+    auto start = std::chrono::high_resolution_clock::now();
+
+    for (int id : dirty) {
+        shapeBounds[primitiveOf[id]] = shapes[id]->bounds();
+    }
+    dirty.clear();
+
+    bvh.refit(shapeBounds);
+    ++refits;
+    if (bvh.cost() > builtCost * rebuildThreshold) {
+        bvh.build(shapeBounds);
+        builtCost = bvh.cost();
+        ++rebuilds;
+    }
+
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+    lastUpdateTime = elapsed.count();
+}
+
+bool Scene::intersect(const Ray& r, double& t, int& id, Vec* point, Vec* normal) const {
+    double inf = t = 1e20;
     Vec pos, norm;
-    for (int i = 0; i < n; ++i) {
-        if ((d = shapes[i]->intersect(r, &pos, &norm)) && d < t) {
+    auto test = [&](int i) {
+        double d = shapes[i]->intersect(r, &pos, &norm);
+        if (d && d < t) {
             t = d; id = i;
             if (point && normal) {
                 *point = pos, * normal = norm;
             }
         }
+        return d;
+    };
+    // The closest plane bounds the traversal
+    for (int i : unbounded) {
+        test(i);
     }
+    int steps = 0;
+    bvh.traverse(r, t, [&](int i) { return test(bounded[i]); }, profilingEnabled ? &steps : nullptr);
+    PROFILE_COUNT(CounterRays, 1);
+    PROFILE_COUNT(CounterTraversalSteps, steps);
     return t < inf;
-}
\ No newline at end of file
+}
@@ -21,13 +21,17 @@ double Sphere::intersect(const Ray& r, Vec* point, Vec* normal) const { // retur
     return t;
 }
 
-void Sphere::sample(Vec& point, Vec& normal, double& pdf) const {
-    double xi1 = rng();
-    double xi2 = rng();
+void Sphere::sample(Vec& point, Vec& normal, double& pdf, Sampler& sampler) const {
+    double xi1, xi2;
+    sampler.get2D(xi1, xi2);
     double z = 2 * xi1 - 1;
     double x = sqrt(1 - z * z) * cos(2 * PI * xi2);
     double y = sqrt(1 - z * z) * sin(2 * PI * xi2);
     point = p + Vec(x, y, z) * rad;
     normal = (point - p).normalize();
     pdf = 1.0 / (4 * PI * rad * rad);
+}
+
+AABB Sphere::bounds() const {
+    return AABB(p - Vec(rad, rad, rad), p + Vec(rad, rad, rad));
 }
\ No newline at end of file
@@ -1,33 +1,63 @@
 #pragma once
 #include "stlmodel.hpp"
+#include "profiler.hpp"
+#include <chrono>
 
-STLModel::STLModel(const std::string& filepath, const BRDF& brdf, Vec pos, Vec e, bool normalize, double scale)
-    : Shape(brdf, e), pos(pos), boundingSphere(1, pos, e, brdf) {
-    loadSTL(filepath);
+// Mesh triangles are shaded through the BRDF of the instance that was hit
+static const DiffuseBRDF meshBRDF(Vec(0, 0, 0));
+
+STLModel::STLModel(const std::string& filepath, bool normalize) : maxDist(0), totalSurfaceArea(0), radius(0), buildTime(0) {
+    if (!loadSTL(filepath)) {
+        triangles.clear();
+        return;
+    }
     if (normalize) {
         normalizeModel();
     }
-    // Shift model into position
-    for (auto& tri : triangles) {
-        tri.v0 = (tri.v0 * scale + pos);
-        tri.v1 = (tri.v1 * scale + pos);
-        tri.v2 = (tri.v2 * scale + pos);
+    for (const auto& tri : triangles) {
+        for (const Vec& v : { tri.v0, tri.v1, tri.v2 }) {
+            radius = std::max(radius, v.length());
+            box.expand(v);
+        }
+    }
+
+    std::vector<AABB> bounds(triangles.size());
+    for (size_t i = 0; i < triangles.size(); ++i) {
+        bounds[i] = triangles[i].bounds();
+    }
+    auto start = std::chrono::high_resolution_clock::now();
+    BVH binary;
+    binary.build(bounds);
+    bvh.build(binary);
+    buildTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+    // Store the triangles in leaf order so leaves address them directly
+    std::vector<Triangle> ordered;
+    ordered.reserve(triangles.size());
+    for (int i : binary.indices) {
+        ordered.push_back(triangles[i]);
+    }
+    triangles.swap(ordered);
+    vertices.resize(triangles.size());
+    for (size_t i = 0; i < triangles.size(); ++i) {
+        vertices[i] = { triangles[i].v0, triangles[i].v1, triangles[i].v2 };
     }
-    maxDist *= scale;
-    boundingSphere.rad = maxDist;
     computeSurfaceAreas();
 }
 
-void STLModel::loadSTL(const std::string& filepath) {
+bool STLModel::loadSTL(const std::string& filepath) {
     std::ifstream file(filepath, std::ios::binary);
     if (!file) {
         std::cerr << "Error opening file: " << filepath << "\n";
-        return;
+        return false;
     }
 
     file.seekg(80); // Skip header
     uint32_t numTriangles;
-    file.read(reinterpret_cast<char*>(&numTriangles), sizeof(numTriangles));
+    if (!file.read(reinterpret_cast<char*>(&numTriangles), sizeof(numTriangles)) || numTriangles == 0) {
+        std::cerr << filepath << ": not a binary STL file with triangles\n";
+        return false;
+    }
 
     Vec min(std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max());
     Vec max(std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest());
@@ -39,12 +69,16 @@ void STLModel::loadSTL(const std::string& filepath) {
         file.read(reinterpret_cast<char*>(v1_f), sizeof(v1_f));
         file.read(reinterpret_cast<char*>(v2_f), sizeof(v2_f));
         file.ignore(2); // Attribute byte count
+        if (!file) {
+            std::cerr << filepath << ": truncated after " << i << " of " << numTriangles << " triangles\n";
+            return false;
+        }
 
         // Convert float to double
         Vec v0(v0_f[0], v0_f[2], v0_f[1]);
         Vec v1(v1_f[0], v1_f[2], v1_f[1]);
         Vec v2(v2_f[0], v2_f[2], v2_f[1]);
-        triangles.emplace_back(v0, v1, v2, Vec(), brdf);
+        triangles.emplace_back(v0, v1, v2, Vec(), meshBRDF);
         for (const Vec& v : { v0, v1, v2 }) {
             min = Vec(std::min(min.x, v.x), std::min(min.y, v.y), std::min(min.z, v.z));
             max = Vec(std::max(max.x, v.x), std::max(max.y, v.y), std::max(max.z, v.z));
@@ -60,6 +94,7 @@ void STLModel::loadSTL(const std::string& filepath) {
         tri.v1 = (tri.v1 - center);
         tri.v2 = (tri.v2 - center);
     }
+    return true;
 }
 
 void STLModel::normalizeModel() {
@@ -73,40 +108,32 @@ void STLModel::normalizeModel() {
     maxDist = 1;
 }
 
-double STLModel::intersect(const Ray& ray, Vec* point, Vec* normal) const {
-    double inf = 1e20;
-    if (!boundingSphere.intersect(ray, 0, 0)) return inf;
-
-    double d, t = inf;
-    Vec pos, norm;
-    for (const auto& triangle : triangles) {
-        if ((d = triangle.intersect(ray, &pos, &norm)) && d < t) {
+double STLModel::intersect(const Ray& ray, Vec* normal) const {
+    const WatertightRay watertight(ray);
+    double t = 0;
+    int hit = -1, steps = 0, tests = 0;
+    bvh.traverse(ray, std::numeric_limits<double>::infinity(), [&](int i) {
+        ++tests;
+        const TriangleVertices& tri = vertices[i];
+        double d = watertight.intersect(tri.v0, tri.v1, tri.v2);
+        if (d && (!t || d < t)) {
             t = d;
-            if (point && normal) {
-                *point = pos, * normal = norm;
-            }
+            hit = i;
         }
+        return d;
+    }, profilingEnabled ? &steps : nullptr);
+    PROFILE_COUNT(CounterTraversalSteps, steps);
+    PROFILE_COUNT(CounterTriangleTests, tests);
+    if (hit >= 0 && normal) {
+        *normal = triangles[hit].n;
     }
     return t;
 }
 
-void STLModel::sample(Vec& point, Vec& normal, double& pdf) const {
-    if (triangles.empty()) {
-        return;
-    }
-
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    std::uniform_real_distribution<float> dist(0.0f, 1.0f);
-    float r = dist(gen);
-
-    size_t index = std::lower_bound(cdf.begin(), cdf.end(), r) - cdf.begin();
-    const Triangle& tri = triangles[index];
-
-    float u = dist(gen);
-    float v = dist(gen);
-    tri.sample(point, normal, pdf);
-    pdf = 1.0 / totalSurfaceArea;
+const Triangle& STLModel::sampleTriangle(double u, double& pdf) const {
+    size_t index = std::min(triangles.size() - 1, static_cast<size_t>(std::lower_bound(cdf.begin(), cdf.end(), u) - cdf.begin()));
+    pdf = triangles[index].area() / totalSurfaceArea;
+    return triangles[index];
 }
 
 void STLModel::computeSurfaceAreas() {
@@ -0,0 +1,74 @@
+#pragma once
+#include "temporal.hpp"
+#include <algorithm>
+
+constexpr float maxReprojectedWeight = 32;   // History weight kept across a reprojection, bounds ghosting
+constexpr float depthTolerance = 0.05f;      // Relative depth difference treated as a disocclusion
+constexpr double missDistance = 1e6;         // Distance used to reproject pixels that hit nothing
+
+TemporalReprojector::TemporalReprojector(int w, int h)
+    : width(w), height(h), color(w * h * 3), weight(w * h), depth(w * h),
+      warpedColor(w * h * 3), warpedWeight(w * h), prevCam(0, 0, 0), valid(false) {}
+
+void TemporalReprojector::reproject(const Camera& cam, const float* newDepth) {
+    if (valid) {
+        const double uu = prevCam.u.dot(prevCam.u), vv = prevCam.v.dot(prevCam.v);
+        for (int y = 0; y < height; ++y) {
+            for (int x = 0; x < width; ++x) {
+                const int i = (height - y - 1) * width + x;
+                warpedWeight[i] = 0;
+
+                // World position of the first hit through this pixel center
+                Vec d = cam.u * ((x + .5) / width - .5) + cam.v * ((y + .5) / height - .5) + cam.w;
+                const bool miss = newDepth[i] <= 0;
+                Vec p = cam.pos + d.normalize() * (miss ? missDistance : newDepth[i]);
+
+                // Project into the previous camera
+                Vec q = p - prevCam.pos;
+                double z = q.dot(prevCam.w);
+                if (z <= 0) continue;
+                int px = static_cast<int>(std::floor((q.dot(prevCam.u) / (uu * z) + .5) * width));
+                int py = static_cast<int>(std::floor((q.dot(prevCam.v) / (vv * z) + .5) * height));
+                if (px < 0 || px >= width || py < 0 || py >= height) continue;
+                const int j = (height - py - 1) * width + px;
+
+                // Reject disocclusions
+                if (miss || depth[j] <= 0) {
+                    if (miss != (depth[j] <= 0)) continue;
+                }
+                else if (std::abs(depth[j] - q.length()) > depthTolerance * q.length()) {
+                    continue;
+                }
+
+                for (int k = 0; k < 3; ++k) {
+                    warpedColor[i * 3 + k] = color[j * 3 + k];
+                }
+                warpedWeight[i] = std::min(weight[j], maxReprojectedWeight);
+            }
+        }
+        color.swap(warpedColor);
+        weight.swap(warpedWeight);
+    }
+
+    std::copy(newDepth, newDepth + width * height, depth.begin());
+    prevCam = cam;
+}
+
+void TemporalReprojector::accumulate(float* data, const float* samples) {
+    if (!valid) {
+        std::fill(color.begin(), color.end(), 0.0f);
+        std::fill(weight.begin(), weight.end(), 0.0f);
+        valid = true;
+    }
+    for (int i = 0; i < width * height; ++i) {
+        const float w = weight[i] + samples[i];
+        for (int k = 0; k < 3; ++k) {
+            float& c = color[i * 3 + k];
+            if (samples[i] > 0) {
+                c += (data[i * 3 + k] - c) * (samples[i] / w);
+            }
+            data[i * 3 + k] = c;
+        }
+        weight[i] = w;
+    }
+}
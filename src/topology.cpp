@@ -0,0 +1,108 @@
+#pragma once
+#include "topology.hpp"
+#include <windows.h>
+#include <thread>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <new>
+
+std::vector<LogicalProcessor> logicalProcessors() {
+    std::vector<LogicalProcessor> processors;
+    DWORD length = 0;
+    GetLogicalProcessorInformationEx(RelationAll, nullptr, &length);
+    std::vector<char> buffer(length);
+    auto info = [&](DWORD offset) { return reinterpret_cast<const SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX*>(buffer.data() + offset); };
+    if (length == 0 || !GetLogicalProcessorInformationEx(RelationAll, reinterpret_cast<SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX*>(buffer.data()), &length)) {
+        const int count = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+        for (int i = 0; i < count; ++i) processors.push_back({ i / 64, i % 64, i, 0, 0 });
+        return processors;
+    }
+
+    // Cores list their hardware threads, nodes the processors of one group each
+    int cores = 0;
+    for (DWORD offset = 0; offset < length; offset += info(offset)->Size) {
+        if (info(offset)->Relationship != RelationProcessorCore) continue;
+        const GROUP_AFFINITY& mask = info(offset)->Processor.GroupMask[0];
+        int sibling = 0;
+        for (int bit = 0; bit < 64; ++bit) {
+            if (mask.Mask & (static_cast<KAFFINITY>(1) << bit)) processors.push_back({ mask.Group, bit, cores, sibling++, 0 });
+        }
+        ++cores;
+    }
+    for (DWORD offset = 0; offset < length; offset += info(offset)->Size) {
+        if (info(offset)->Relationship != RelationNumaNode) continue;
+        const GROUP_AFFINITY& mask = info(offset)->NumaNode.GroupMask;
+        for (LogicalProcessor& processor : processors) {
+            if (processor.group == mask.Group && (mask.Mask & (static_cast<KAFFINITY>(1) << processor.number))) {
+                processor.node = static_cast<int>(info(offset)->NumaNode.NodeNumber);
+            }
+        }
+    }
+    return processors;
+}
+
+bool parseThreadPlacement(const char* option, const char* value, ThreadPlacement& placement) {
+    if (!strcmp(option, "--threads")) placement.threads = std::max(0, atoi(value));
+    else if (!strcmp(option, "--smt")) placement.smt = strcmp(value, "off") != 0;
+    else if (!strcmp(option, "--pin")) placement.pin = strcmp(value, "off") != 0;
+    else return false;
+    return true;
+}
+
+std::vector<LogicalProcessor> placeThreads(const ThreadPlacement& placement) {
+    std::vector<LogicalProcessor> processors = logicalProcessors();
+    if (!placement.smt) {
+        processors.erase(std::remove_if(processors.begin(), processors.end(), [](const LogicalProcessor& p) { return p.sibling > 0; }), processors.end());
+    }
+
+    // Rank each processor among those of its node and sibling index, so sorting by rank takes
+    // one core from every node in turn
+    std::vector<int> rank(processors.size());
+    for (size_t i = 0; i < processors.size(); ++i) {
+        for (size_t j = 0; j < i; ++j) {
+            if (processors[j].node == processors[i].node && processors[j].sibling == processors[i].sibling) ++rank[i];
+        }
+    }
+    std::vector<int> order(processors.size());
+    for (size_t i = 0; i < order.size(); ++i) order[i] = static_cast<int>(i);
+    std::stable_sort(order.begin(), order.end(), [&](int a, int b) {
+        if (processors[a].sibling != processors[b].sibling) return processors[a].sibling < processors[b].sibling;
+        if (rank[a] != rank[b]) return rank[a] < rank[b];
+        return processors[a].node < processors[b].node;
+    });
+
+    const int count = placement.threads > 0 ? placement.threads : static_cast<int>(order.size());
+    std::vector<LogicalProcessor> placed;
+    placed.reserve(count);
+    for (int i = 0; i < count; ++i) placed.push_back(processors[order[i % order.size()]]);
+    return placed;
+}
+
+bool pinThread(const LogicalProcessor& processor) {
+    GROUP_AFFINITY affinity = {};
+    affinity.Group = static_cast<WORD>(processor.group);
+    affinity.Mask = static_cast<KAFFINITY>(1) << processor.number;
+    return SetThreadGroupAffinity(GetCurrentThread(), &affinity, nullptr) != 0;
+}
+
+// Pages are only placed when first touched, on the preferred node given here
+NodeBuffer::NodeBuffer(size_t bytes, int node) : memory(nullptr), bytes(bytes) {
+    if (bytes == 0) return;
+    if (node >= 0) memory = VirtualAllocExNuma(GetCurrentProcess(), nullptr, bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE, static_cast<DWORD>(node));
+    if (!memory) memory = VirtualAlloc(nullptr, bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    if (!memory) throw std::bad_alloc();
+}
+
+NodeBuffer::~NodeBuffer() {
+    if (memory) VirtualFree(memory, 0, MEM_RELEASE);
+}
+
+NodeBuffer& NodeBuffer::operator=(NodeBuffer&& other) {
+    if (this != &other) {
+        if (memory) VirtualFree(memory, 0, MEM_RELEASE);
+        memory = other.memory, bytes = other.bytes;
+        other.memory = nullptr, other.bytes = 0;
+    }
+    return *this;
+}
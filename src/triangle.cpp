@@ -8,36 +8,49 @@ Triangle::Triangle(Vec v0, Vec v1, Vec v2, Vec e, const BRDF& brdf)
     n = edge1.cross(edge2).normalize();
 }
 
-double Triangle::intersect(const Ray& ray, Vec* point, Vec* normal) const {
-    const Vec edge1 = v1 - v0;
-    const Vec edge2 = v2 - v0;
-    const Vec h = ray.d.cross(edge2);
-    const double a = edge1.dot(h);
+WatertightRay::WatertightRay(const Ray& r) : o(r.o) {
+    const double ax = std::abs(r.d.x), ay = std::abs(r.d.y), az = std::abs(r.d.z);
+    kz = ax > ay && ax > az ? 0 : ay > az ? 1 : 2;
+    kx = (kz + 1) % 3;
+    ky = (kx + 1) % 3;
+    // Keep the winding so that the sign of the determinant still tells the side
+    if (r.d[kz] < 0) std::swap(kx, ky);
+    sx = r.d[kx] / r.d[kz];
+    sy = r.d[ky] / r.d[kz];
+    sz = 1.0 / r.d[kz];
+}
 
-    if (std::abs(a) < 1e-8) return 0;
+double WatertightRay::intersect(const Vec& v0, const Vec& v1, const Vec& v2) const {
+    const Vec a = v0 - o, b = v1 - o, c = v2 - o;
+    const double ax = a[kx] - sx * a[kz], ay = a[ky] - sy * a[kz];
+    const double bx = b[kx] - sx * b[kz], by = b[ky] - sy * b[kz];
+    const double cx = c[kx] - sx * c[kz], cy = c[ky] - sy * c[kz];
 
-    const double f = 1.0 / a;
-    const Vec s = ray.o - v0;
-    const double u = f * s.dot(h);
-    if (u < 0.0 || u > 1.0) return 0;
+    // Edge functions, a point on an edge counts as inside
+    const double u = cx * by - cy * bx;
+    const double v = ax * cy - ay * cx;
+    const double w = bx * ay - by * ax;
+    if ((u < 0 || v < 0 || w < 0) && (u > 0 || v > 0 || w > 0)) return 0;
 
-    const Vec q = s.cross(edge1);
-    const double v = f * ray.d.dot(q);
-    if (v < 0.0 || u + v > 1.0) return 0;
+    const double det = u + v + w;
+    if (det == 0) return 0;
 
-    const double t = f * edge2.dot(q);
-    if (t <= 1e-8) return 0;
+    const double t = (u * a[kz] + v * b[kz] + w * c[kz]) * sz / det;
+    return t > 1e-8 ? t : 0;    // Keeps rays leaving the surface from hitting it again
+}
 
-    if (point && normal) {
+double Triangle::intersect(const Ray& ray, Vec* point, Vec* normal) const {
+    const double t = WatertightRay(ray).intersect(v0, v1, v2);
+    if (t && point && normal) {
         *point = ray.o + ray.d * t;
         *normal = n;
     }
     return t;
 }
 
-void Triangle::sample(Vec& point, Vec& normal, double& pdf) const {
-    double r1 = rng();
-    double r2 = rng();
+void Triangle::sample(Vec& point, Vec& normal, double& pdf, Sampler& sampler) const {
+    double r1, r2;
+    sampler.get2D(r1, r2);
 
     double sqrt_r1 = sqrt(r1);
     double u = 1 - sqrt_r1;
@@ -52,5 +65,13 @@ void Triangle::sample(Vec& point, Vec& normal, double& pdf) const {
 }
 
 double Triangle::area() const {
-    return 0.5 * ((v1 - v0).length() * (v2 - v0).length());
+    return 0.5 * ((v1 - v0).cross(v2 - v0)).length();
+}
+
+AABB Triangle::bounds() const {
+    AABB box;
+    box.expand(v0);
+    box.expand(v1);
+    box.expand(v2);
+    return box;
 }
\ No newline at end of file
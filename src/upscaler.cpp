@@ -0,0 +1,72 @@
+#pragma once
+#include "upscaler.hpp"
+#include <cmath>
+#include <algorithm>
+
+constexpr float depthSigma = 0.05f;     // Relative depth difference falling off to 1/e
+constexpr float normalPower = 16;       // Sharpness of the normal similarity falloff
+
+static float guideWeight(const float* depth, const float* normal, int i, int j) {
+    float w = 1;
+    if (depth) {
+        bool missI = depth[i] <= 0, missJ = depth[j] <= 0;
+        if (missI != missJ) return 0;
+        if (!missI) w *= std::exp(-std::abs(depth[i] - depth[j]) / (depthSigma * depth[i]));
+    }
+    if (normal) {
+        float c = normal[i * 3] * normal[j * 3] + normal[i * 3 + 1] * normal[j * 3 + 1] + normal[i * 3 + 2] * normal[j * 3 + 2];
+        w *= std::pow(std::max(0.0f, c), normalPower);
+    }
+    return w;
+}
+
+void upscale(const float* src, const float* srcSamples, int srcWidth, int srcHeight,
+             float* dst, float* dstSamples, int width, int height,
+             const float* depth, const float* normal) {
+    const float pixelArea = static_cast<float>(srcWidth * srcHeight) / (width * height);
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            const int i = (height - y - 1) * width + x;
+            const float lx = (x + .5f) * srcWidth / width - .5f, ly = (y + .5f) * srcHeight / height - .5f;
+            const int x0 = static_cast<int>(std::floor(lx)), y0 = static_cast<int>(std::floor(ly));
+            const float fx = lx - x0, fy = ly - y0;
+
+            float color[3] = { 0, 0, 0 }, samples = 0, total = 0;
+            float fallbackColor[3] = { 0, 0, 0 }, fallbackSamples = 0, fallbackTotal = 0;
+            for (int k = 0; k < 4; ++k) {
+                const int px = std::min(std::max(x0 + (k & 1), 0), srcWidth - 1);
+                const int py = std::min(std::max(y0 + (k >> 1), 0), srcHeight - 1);
+                const int j = (srcHeight - py - 1) * srcWidth + px;
+                if (srcSamples[j] <= 0) continue;
+
+                // Full resolution pixel under the low resolution pixel's center
+                const int gx = std::min(static_cast<int>((px + .5f) * width / srcWidth), width - 1);
+                const int gy = std::min(static_cast<int>((py + .5f) * height / srcHeight), height - 1);
+                const int g = (height - gy - 1) * width + gx;
+
+                const float bilinear = ((k & 1) ? fx : 1 - fx) * ((k >> 1) ? fy : 1 - fy);
+                const float w = bilinear * guideWeight(depth, normal, i, g);
+                for (int c = 0; c < 3; ++c) {
+                    color[c] += src[j * 3 + c] * w;
+                    fallbackColor[c] += src[j * 3 + c] * bilinear;
+                }
+                samples += srcSamples[j] * w;
+                fallbackSamples += srcSamples[j] * bilinear;
+                total += w;
+                fallbackTotal += bilinear;
+            }
+
+            // No neighbor shares this pixel's surface, fall back to plain bilinear
+            if (total < 1e-4f) {
+                std::copy(fallbackColor, fallbackColor + 3, color);
+                samples = fallbackSamples;
+                total = fallbackTotal;
+            }
+            for (int c = 0; c < 3; ++c) {
+                dst[i * 3 + c] = total > 0 ? color[c] / total : 0;
+            }
+            // A low resolution sample is spread over all the pixels it covers
+            dstSamples[i] = total > 0 ? samples / total * pixelArea : 0;
+        }
+    }
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include "widebvh.hpp"
+#include <cmath>
+
+void WideBVH::build(const BVH& bvh) {
+    nodes.clear();
+    if (bvh.nodes.empty()) return;
+    nodes.reserve(bvh.nodes.size() / 2 + 1);
+    collapse(bvh, 0);
+}
+
+int WideBVH::collapse(const BVH& bvh, int binaryNode) {
+    // Open the largest inner child until there are four
+    int children[4], numChildren = 0;
+    const BVHNode& root = bvh.nodes[binaryNode];
+    if (root.count) {
+        children[numChildren++] = binaryNode;
+    }
+    else {
+        children[numChildren++] = root.start;
+        children[numChildren++] = root.start + 1;
+    }
+    while (numChildren < 4) {
+        int best = -1;
+        double bestArea = -1;
+        for (int i = 0; i < numChildren; ++i) {
+            const BVHNode& c = bvh.nodes[children[i]];
+            if (!c.count && c.box.surfaceArea() > bestArea) {
+                bestArea = c.box.surfaceArea();
+                best = i;
+            }
+        }
+        if (best < 0) break;
+        const int opened = children[best];
+        children[best] = bvh.nodes[opened].start;
+        children[numChildren++] = bvh.nodes[opened].start + 1;
+    }
+
+    const int index = static_cast<int>(nodes.size());
+    nodes.push_back(WideNode());
+    WideNode node = {};
+    node.numChildren = static_cast<uint8_t>(numChildren);
+
+    // Power of two steps so that dequantizing in float is exact
+    const AABB& box = root.box;
+    double step[3];
+    for (int axis = 0; axis < 3; ++axis) {
+        const double lo = box.min[axis], extent = box.max[axis] - lo;
+        float origin = static_cast<float>(lo);
+        if (origin > lo) origin = std::nextafter(origin, -INFINITY);
+        int e = extent > 0 ? static_cast<int>(std::ceil(std::log2((box.max[axis] - origin) / 255))) : -100;
+        e = std::max(-100, std::min(100, e));
+        while (std::ldexp(255.0, e) < box.max[axis] - origin) ++e;
+        node.origin[axis] = origin;
+        node.exponent[axis] = static_cast<int8_t>(e);
+        step[axis] = std::ldexp(1.0, e);
+    }
+
+    for (int i = 0; i < numChildren; ++i) {
+        const BVHNode& c = bvh.nodes[children[i]];
+        for (int axis = 0; axis < 3; ++axis) {
+            const double lo = std::floor((c.box.min[axis] - node.origin[axis]) / step[axis]);
+            const double hi = std::ceil((c.box.max[axis] - node.origin[axis]) / step[axis]);
+            node.lo[axis][i] = static_cast<uint8_t>(std::max(0.0, std::min(255.0, lo)));
+            node.hi[axis][i] = static_cast<uint8_t>(std::max(0.0, std::min(255.0, hi)));
+        }
+        // Binary leaves hold at most maxLeafSize primitives, which fits in three bits
+        node.child[i] = c.count ? ~(c.start << 3 | c.count) : collapse(bvh, children[i]);
+    }
+    nodes[index] = node;
+    return index;
+}
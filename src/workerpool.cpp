@@ -0,0 +1,62 @@
+#pragma once
+#include "workerpool.hpp"
+#include "profiler.hpp"
+#include <cstdio>
+
+WorkerPool::WorkerPool(const ThreadPlacement& placement)
+    : processors(placeThreads(placement)), pinned(placement.pin), job(nullptr), call(nullptr), generation(0), stopping(false), finished(static_cast<int>(processors.size())) {
+    threads.reserve(processors.size());
+    for (int i = 0; i < static_cast<int>(processors.size()); ++i) {
+        threads.emplace_back(&WorkerPool::workerLoop, this, i);
+    }
+}
+
+WorkerPool::~WorkerPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+void WorkerPool::start(void* job_, void (*call_)(void*, int)) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        job = job_;
+        call = call_;
+        finished.store(0);
+        ++generation;
+    }
+    wake.notify_all();
+}
+
+void WorkerPool::wait() {
+    std::unique_lock<std::mutex> lock(mutex);
+    idle.wait(lock, [this] { return done(); });
+}
+
+void WorkerPool::workerLoop(int worker) {
+    profileThreadName("worker");
+    if (pinned && !pinThread(processors[worker])) {
+        fprintf(stderr, "Could not pin worker %d to processor %d of group %d\n", worker, processors[worker].number, processors[worker].group);
+    }
+    unsigned seen = 0;
+    while (true) {
+        std::unique_lock<std::mutex> lock(mutex);
+        wake.wait(lock, [&] { return stopping || generation != seen; });
+        if (stopping) return;
+        seen = generation;
+        void* currentJob = job;
+        auto currentCall = call;
+        lock.unlock();
+
+        currentCall(currentJob, worker);
+        if (++finished == size()) {
+            std::lock_guard<std::mutex> idleLock(mutex);
+            idle.notify_all();
+        }
+    }
+}
@@ -0,0 +1,99 @@
+"""
+Renders every bundled scene, and every bundled model in a scene of its own, at a low sample count with a
+fixed seed through --render and --merge, and checks each image against its stored reference with --compare.
+
+    python tests/references.py <tracer executable> [--update] [--tolerance t] [--only name]
+
+Run from anywhere; scenes name their files relative to the repository root, which the renders run in.
+Offline renders are deterministic, so a build of the same code gives the references back bit for bit. Other
+compilers and instruction sets round differently and some paths take other turns, which the tolerance on
+the RMSE relative to the reference's mean (see --compare in offline.hpp) leaves room for. Changes that
+shift the image by more than that, such as a bias in light sampling, fail.
+
+--update renders the references anew. Do so only for intended changes to the images, and say why in the
+commit.
+"""
+
+import argparse
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+REFERENCES = os.path.join("tests", "references")
+
+# Name, scene
+CASES = [
+    ("cornell", "rsrc/scenes/cornell.scene"),
+    ("caustics", "rsrc/scenes/caustics.scene"),
+    ("outdoor", "rsrc/scenes/outdoor.scene"),
+    ("dusk", "rsrc/scenes/dusk.scene"),
+    ("charizard", "tests/scenes/charizard.scene"),
+    ("cube", "tests/scenes/cube.scene"),
+    ("dodecahedron", "tests/scenes/dodecahedron.scene"),
+    ("octahedron", "tests/scenes/octahedron.scene"),
+    ("pikachu", "tests/scenes/pikachu.scene"),
+    ("square-pyramid", "tests/scenes/square-pyramid.scene"),
+]
+
+SPP = 16
+SEED = 0
+WIDTH, HEIGHT = 128, 96
+TOLERANCE = 0.02    # Largest RMSE as a fraction of the reference's mean radiance
+
+
+def run(command):
+    result = subprocess.run(command, cwd=ROOT, stdout=subprocess.PIPE, stderr=subprocess.STDOUT, universal_newlines=True)
+    return result.returncode, result.stdout.strip()
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Check renders of the bundled scenes and models against reference images")
+    parser.add_argument("tracer", help="path to the tracer executable")
+    parser.add_argument("--update", action="store_true", help="write the references instead of checking against them")
+    parser.add_argument("--tolerance", type=float, default=TOLERANCE, help="largest RMSE relative to the reference's mean")
+    parser.add_argument("--only", action="append", help="check only the named case, may be repeated")
+    args = parser.parse_args()
+    tracer = os.path.abspath(args.tracer)
+
+    failures = []
+    scratch = tempfile.mkdtemp(prefix="references-")
+    try:
+        for name, scene in CASES:
+            if args.only and name not in args.only:
+                continue
+            checkpoint = os.path.join(scratch, name + ".ckpt")
+            image = os.path.join(scratch, name + ".pfm")
+            reference = os.path.join(ROOT, REFERENCES, name + ".pfm")
+
+            status, output = run([tracer, "--render", scene, checkpoint, "--spp", str(SPP), "--seed", str(SEED),
+                                  "--size", str(WIDTH), str(HEIGHT)])
+            if status == 0:
+                status, output = run([tracer, "--merge", image, checkpoint])
+            if status != 0:
+                print("%-15s render failed\n%s" % (name, output))
+                failures.append(name)
+                continue
+
+            if args.update:
+                shutil.copyfile(image, reference)
+                print("%-15s updated %s" % (name, os.path.relpath(reference, ROOT)))
+                continue
+            status, output = run([tracer, "--compare", image, reference, str(args.tolerance)])
+            print("%-15s %s" % (name, output.splitlines()[-1] if output else "no output"))
+            if status != 0:
+                failures.append(name)
+    finally:
+        shutil.rmtree(scratch, ignore_errors=True)
+
+    if failures:
+        print("%d of the references failed: %s" % (len(failures), ", ".join(failures)))
+        return 1
+    print("All references %s" % ("updated" if args.update else "match within %g" % args.tolerance))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())